@@ -0,0 +1,181 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CharacterMotionPresets.h"
+#include "MotionCurveCache.h"
+#include "Curves/CurveFloat.h"
+#include "Engine/Engine.h"
+
+UCharacterMotionPresetRegistry* UCharacterMotionPresetRegistry::Get()
+{
+	return GEngine ? GEngine->GetEngineSubsystem<UCharacterMotionPresetRegistry>() : nullptr;
+}
+
+void UCharacterMotionPresetRegistry::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	// The table only holds soft references, loading it does not load the curves
+	LoadedPresetTable = PresetTable.LoadSynchronous();
+	if (LoadedPresetTable == nullptr)
+	{
+		UE_LOG(LogTemp, Log, TEXT("UCharacterMotionPresetRegistry - no motion preset table configured"));
+		BuildCurveManifest();
+		return;
+	}
+
+	if (LoadedPresetTable->GetRowStruct() == nullptr || !LoadedPresetTable->GetRowStruct()->IsChildOf(FCharacterMotionPreset::StaticStruct()))
+	{
+		UE_LOG(LogTemp, Error, TEXT("UCharacterMotionPresetRegistry - %s does not use FCharacterMotionPreset rows"), *LoadedPresetTable->GetPathName());
+		BuildCurveManifest();
+		return;
+	}
+
+	PresetNames = LoadedPresetTable->GetRowNames();
+	PresetNames.Sort(FNameLexicalLess());
+
+	if (PresetNames.Num() > MaxPresets)
+	{
+		UE_LOG(LogTemp, Error, TEXT("UCharacterMotionPresetRegistry - %s has %d rows, only the first %d are usable"), *LoadedPresetTable->GetPathName(), PresetNames.Num(), MaxPresets);
+		PresetNames.SetNum(MaxPresets);
+	}
+
+	Presets.Reserve(PresetNames.Num());
+	for (const FName& PresetName : PresetNames)
+	{
+		Presets.Add(LoadedPresetTable->FindRow<FCharacterMotionPreset>(PresetName, TEXT("UCharacterMotionPresetRegistry")));
+	}
+
+	BuildCurveManifest();
+}
+
+void UCharacterMotionPresetRegistry::Deinitialize()
+{
+	for (const TSharedPtr<FStreamableHandle>& CurveLoadHandle : CurveLoadHandles)
+	{
+		CurveLoadHandle->ReleaseHandle();
+	}
+	CurveLoadHandles.Reset();
+	CurveManifest.Reset();
+	CurveIndexByPath.Reset();
+	RequestedCurves.Reset();
+	UnlistedCurves.Reset();
+
+	PresetNames.Reset();
+	Presets.Reset();
+	LoadedPresetTable = nullptr;
+
+	Super::Deinitialize();
+}
+
+int32 UCharacterMotionPresetRegistry::FindPresetIndex(FName PresetName) const
+{
+	return PresetNames.Find(PresetName);
+}
+
+uint8 UCharacterMotionPresetRegistry::FindCurveIndex(const TSoftObjectPtr<UCurveFloat>& Curve) const
+{
+	if (Curve.IsNull())
+	{
+		return NoCurve;
+	}
+
+	const uint8* CurveIndex = CurveIndexByPath.Find(Curve.ToSoftObjectPath());
+	return CurveIndex ? *CurveIndex : NoCurve;
+}
+
+bool UCharacterMotionPresetRegistry::IsCurveSendable(const TSoftObjectPtr<UCurveFloat>& Curve) const
+{
+	if (Curve.IsNull() || CurveIndexByPath.Contains(Curve.ToSoftObjectPath()))
+	{
+		return true;
+	}
+
+	bool bAlreadyEnsured = false;
+	UnlistedCurves.Add(Curve.ToSoftObjectPath(), &bAlreadyEnsured);
+	ensureAlwaysMsgf(bAlreadyEnsured, TEXT("UCharacterMotionPresetRegistry - %s is not in a preset or AdditionalCurves, motions using it can't be sent"), *Curve.ToString());
+	return false;
+}
+
+void UCharacterMotionPresetRegistry::PreloadCurves(const TArray<FSoftObjectPath>& CurvePaths)
+{
+	TArray<FSoftObjectPath> PathsToLoad;
+	for (const FSoftObjectPath& CurvePath : CurvePaths)
+	{
+		// Manifest curves and the ones of characters spawned before are already requested
+		bool bAlreadyRequested = false;
+		if (!CurvePath.IsNull())
+		{
+			RequestedCurves.Add(CurvePath, &bAlreadyRequested);
+		}
+		if (!CurvePath.IsNull() && !bAlreadyRequested)
+		{
+			PathsToLoad.Add(CurvePath);
+		}
+	}
+
+	if (PathsToLoad.Num() > 0)
+	{
+		RequestCurveLoad(MoveTemp(PathsToLoad));
+	}
+}
+
+void UCharacterMotionPresetRegistry::BuildCurveManifest()
+{
+	TSet<FSoftObjectPath> CurvePaths;
+	for (const FCharacterMotionPreset* Preset : Presets)
+	{
+		if (Preset)
+		{
+			CurvePaths.Add(Preset->MovementSpeedCurve.ToSoftObjectPath());
+			CurvePaths.Add(Preset->MovementZMultiplierCurve.ToSoftObjectPath());
+		}
+	}
+	for (const TSoftObjectPtr<UCurveFloat>& AdditionalCurve : AdditionalCurves)
+	{
+		CurvePaths.Add(AdditionalCurve.ToSoftObjectPath());
+	}
+	CurvePaths.Remove(FSoftObjectPath());
+
+	CurveManifest = CurvePaths.Array();
+	CurveManifest.Sort([](const FSoftObjectPath& A, const FSoftObjectPath& B) { return A.ToString() < B.ToString(); });
+
+	if (CurveManifest.Num() > MaxCurves)
+	{
+		UE_LOG(LogTemp, Error, TEXT("UCharacterMotionPresetRegistry - %d motion curves, only the first %d can be sent"), CurveManifest.Num(), MaxCurves);
+		CurveManifest.SetNum(MaxCurves);
+	}
+
+	for (int32 CurveIndex = 0; CurveIndex < CurveManifest.Num(); ++CurveIndex)
+	{
+		CurveIndexByPath.Add(CurveManifest[CurveIndex], (uint8)CurveIndex);
+	}
+
+	RequestedCurves.Append(CurveManifest);
+	if (CurveManifest.Num() > 0)
+	{
+		RequestCurveLoad(CurveManifest);
+	}
+}
+
+void UCharacterMotionPresetRegistry::RequestCurveLoad(TArray<FSoftObjectPath> CurvePaths)
+{
+	const FStreamableDelegate OnLoaded = FStreamableDelegate::CreateUObject(this, &UCharacterMotionPresetRegistry::OnCurvesLoaded, CurvePaths);
+	TSharedPtr<FStreamableHandle> CurveLoadHandle = StreamableManager.RequestAsyncLoad(MoveTemp(CurvePaths), OnLoaded, FStreamableManager::AsyncLoadHighPriority);
+	if (CurveLoadHandle.IsValid())
+	{
+		CurveLoadHandles.Add(CurveLoadHandle);
+	}
+}
+
+void UCharacterMotionPresetRegistry::OnCurvesLoaded(TArray<FSoftObjectPath> CurvePaths)
+{
+	// Baked right away, so that the first motion using one only looks it up. They stay loaded, so they stay baked across map travels.
+	FMotionCurveCache& CurveCache = FMotionCurveCache::Get();
+	for (const FSoftObjectPath& CurvePath : CurvePaths)
+	{
+		if (const UCurveFloat* Curve = Cast<UCurveFloat>(CurvePath.ResolveObject()))
+		{
+			CurveCache.FindOrBakePinned(Curve);
+		}
+	}
+}
@@ -0,0 +1,123 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataTable.h"
+#include "Engine/EngineTypes.h"
+#include "Engine/StreamableManager.h"
+#include "Subsystems/EngineSubsystem.h"
+#include "CharacterMotionPresets.generated.h"
+
+class UCurveFloat;
+
+/**
+ * Shared description of a character motion. Only the index of the preset is sent over the network,
+ * the per-instance start and target are sent along with it.
+ */
+USTRUCT(BlueprintType)
+struct MYPROJECT_API FCharacterMotionPreset : public FTableRowBase
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, Category = Motion)
+	TSoftObjectPtr<UCurveFloat> MovementSpeedCurve;
+
+	UPROPERTY(EditAnywhere, Category = Motion)
+	TSoftObjectPtr<UCurveFloat> MovementZMultiplierCurve;
+
+	UPROPERTY(EditAnywhere, Category = Motion)
+	uint8 MaxZOffset = 0;
+
+	/* Duration of the motion in seconds */
+	UPROPERTY(EditAnywhere, Category = Motion, meta = (ClampMin = "1"))
+	uint8 Duration = 1;
+
+	UPROPERTY(EditAnywhere, Category = Motion)
+	bool bSweepDuringMotion = false;
+
+	UPROPERTY(EditAnywhere, Category = Motion)
+	TEnumAsByte<EMovementMode> MovementModeOnEnd = EMovementMode::MOVE_Walking;
+};
+
+/**
+ * Loads the motion presets from the DataTable set in the game config when the engine starts.
+ * Presets are indexed by row name order so that every build loading the same table agrees on the indices.
+ * Their curves and AdditionalCurves make the curve manifest, sorted by path for the same
+ * reason. Motions send curves as manifest indices and can't use a curve outside of it. Every manifest curve is loaded
+ * asynchronously when the engine starts and baked into the FMotionCurveCache as soon as it lands, motions never wait for one.
+ */
+UCLASS(config = Game, defaultconfig)
+class MYPROJECT_API UCharacterMotionPresetRegistry : public UEngineSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	/* Indices are sent as a byte, the last value meaning no preset */
+	static constexpr int32 MaxPresets = MAX_uint8;
+
+	static UCharacterMotionPresetRegistry* Get();
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	/* Returns the index of the preset with the given row name, or INDEX_NONE if there is none */
+	int32 FindPresetIndex(FName PresetName) const;
+
+	const FCharacterMotionPreset* GetPreset(int32 PresetIndex) const
+	{
+		return Presets.IsValidIndex(PresetIndex) ? Presets[PresetIndex] : nullptr;
+	}
+
+	int32 GetNumPresets() const { return Presets.Num(); }
+
+	/* Curve indices are sent as a byte, the last value meaning no curve */
+	static constexpr int32 MaxCurves = MAX_uint8;
+	static constexpr uint8 NoCurve = MAX_uint8;
+
+	/* Returns the manifest index of a curve, or NoCurve if it is null or not in the manifest */
+	uint8 FindCurveIndex(const TSoftObjectPtr<UCurveFloat>& Curve) const;
+
+	/* True if the curve can be sent, null curves included. Ensures once per curve that is not in the manifest. */
+	bool IsCurveSendable(const TSoftObjectPtr<UCurveFloat>& Curve) const;
+
+	TSoftObjectPtr<UCurveFloat> GetCurve(uint8 CurveIndex) const
+	{
+		return CurveManifest.IsValidIndex(CurveIndex) ? TSoftObjectPtr<UCurveFloat>(CurveManifest[CurveIndex]) : TSoftObjectPtr<UCurveFloat>();
+	}
+
+	/* Loads curves asynchronously and keeps them loaded, for the ones used outside of presets */
+	void PreloadCurves(const TArray<FSoftObjectPath>& CurvePaths);
+
+private:
+
+	void BuildCurveManifest();
+	void RequestCurveLoad(TArray<FSoftObjectPath> CurvePaths);
+	void OnCurvesLoaded(TArray<FSoftObjectPath> CurvePaths);
+
+	UPROPERTY(Config)
+	TSoftObjectPtr<UDataTable> PresetTable;
+
+	// Curves used by motions that are not presets, such as the MovementCurve and MovementZOffsetCurve of the character dashes,
+	// so that they can be sent and are preloaded. Listed here rather than read from the character classes, which would load them.
+	UPROPERTY(Config)
+	TArray<TSoftObjectPtr<UCurveFloat>> AdditionalCurves;
+
+	UPROPERTY(Transient)
+	UDataTable* LoadedPresetTable = nullptr;
+
+	TArray<FName> PresetNames;
+	TArray<const FCharacterMotionPreset*> Presets;
+
+	TArray<FSoftObjectPath> CurveManifest;
+	TMap<FSoftObjectPath, uint8> CurveIndexByPath;
+
+	// Keep the curves they requested loaded
+	FStreamableManager StreamableManager;
+	TArray<TSharedPtr<FStreamableHandle>> CurveLoadHandles;
+	TSet<FSoftObjectPath> RequestedCurves;
+
+	// Curves motions tried to use that are not in the manifest, ensured about once
+	mutable TSet<FSoftObjectPath> UnlistedCurves;
+};
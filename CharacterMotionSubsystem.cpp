@@ -0,0 +1,228 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CharacterMotionSubsystem.h"
+#include "MyCharacterMovementComponent.h"
+#include "MotionCurveCache.h"
+#include "MotionDeterminism.h"
+#include "Engine/World.h"
+#include "GameFramework/GameStateBase.h"
+
+namespace CharacterMotionSubsystemCVars
+{
+	int32 EnableBatchedMotion = 1;
+	FAutoConsoleVariableRef CVarEnableBatchedMotion(
+		TEXT("p.EnableBatchedMotion"),
+		EnableBatchedMotion,
+		TEXT("Whether to evaluate the replicated motions of simulated proxies in a single batch before actors tick.\n")
+		TEXT("0: Disable, 1: Enable"),
+		ECVF_Default);
+}
+
+bool UCharacterMotionSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	return !IsRunningDedicatedServer() && Super::ShouldCreateSubsystem(Outer);
+}
+
+void UCharacterMotionSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	PreActorTickHandle = FWorldDelegates::OnWorldPreActorTick.AddUObject(this, &UCharacterMotionSubsystem::OnWorldPreActorTick);
+}
+
+void UCharacterMotionSubsystem::Deinitialize()
+{
+	FWorldDelegates::OnWorldPreActorTick.Remove(PreActorTickHandle);
+
+	for (UMyCharacterMovementComponent* Component : Components)
+	{
+		Component->BatchedMotionSlot = INDEX_NONE;
+	}
+	Components.Reset();
+
+	Super::Deinitialize();
+}
+
+void UCharacterMotionSubsystem::AddOrUpdateMotion(UMyCharacterMovementComponent* Component)
+{
+	int32 Slot = Component->BatchedMotionSlot;
+	if (Slot == INDEX_NONE)
+	{
+		Slot = Components.Add(Component);
+		Component->BatchedMotionSlot = Slot;
+
+		SpeedCurveHandles.Add(INDEX_NONE);
+		ZMultiplierCurveHandles.Add(INDEX_NONE);
+		Deterministic.Add(false);
+		Ended.Add(false);
+
+		if (Slot >= Streams[0].Num())
+		{
+			for (FStream& Stream : Streams)
+			{
+				Stream.AddZeroed(VectorWidth);
+			}
+		}
+	}
+
+	const FCharacterMotionData& MotionData = Component->MotionData;
+	const FVector Delta = MotionData.TargetLocation - MotionData.StartLocation;
+	const FRotator DeltaRotation = (MotionData.TargetRotation - MotionData.StartRotation).GetNormalized();
+
+	Streams[StartX][Slot] = MotionData.StartLocation.X;
+	Streams[StartY][Slot] = MotionData.StartLocation.Y;
+	Streams[StartZ][Slot] = MotionData.StartLocation.Z;
+	Streams[DeltaX][Slot] = Delta.X;
+	Streams[DeltaY][Slot] = Delta.Y;
+	Streams[DeltaZ][Slot] = Delta.Z;
+	Streams[StartPitch][Slot] = MotionData.StartRotation.Pitch;
+	Streams[StartYaw][Slot] = MotionData.StartRotation.Yaw;
+	Streams[StartRoll][Slot] = MotionData.StartRotation.Roll;
+	Streams[DeltaPitch][Slot] = DeltaRotation.Pitch;
+	Streams[DeltaYaw][Slot] = DeltaRotation.Yaw;
+	Streams[DeltaRoll][Slot] = DeltaRotation.Roll;
+	Streams[ServerStartTime][Slot] = Component->ReplicatedMotion.ServerStartTime;
+	Streams[ClockDuration][Slot] = MotionData.GetClockDuration();
+	Streams[MaxZOffset][Slot] = MotionData.MaxZOffset;
+	Streams[EvaluatedTime][Slot] = -1.0f;
+
+	SpeedCurveHandles[Slot] = MotionData.SpeedCurveHandle;
+	ZMultiplierCurveHandles[Slot] = MotionData.ZMultiplierCurveHandle;
+	Deterministic[Slot] = MotionData.bDeterministic;
+}
+
+void UCharacterMotionSubsystem::RemoveMotion(UMyCharacterMovementComponent* Component)
+{
+	const int32 Slot = Component->BatchedMotionSlot;
+	if (Slot == INDEX_NONE)
+	{
+		return;
+	}
+
+	const int32 LastSlot = Components.Num() - 1;
+	if (Slot != LastSlot)
+	{
+		Components[Slot] = Components[LastSlot];
+		Components[Slot]->BatchedMotionSlot = Slot;
+
+		SpeedCurveHandles[Slot] = SpeedCurveHandles[LastSlot];
+		ZMultiplierCurveHandles[Slot] = ZMultiplierCurveHandles[LastSlot];
+		Deterministic[Slot] = Deterministic[LastSlot];
+		Ended[Slot] = Ended[LastSlot];
+
+		for (FStream& Stream : Streams)
+		{
+			Stream[Slot] = Stream[LastSlot];
+		}
+	}
+
+	for (FStream& Stream : Streams)
+	{
+		Stream[LastSlot] = 0.0f;
+	}
+
+	Components.RemoveAt(LastSlot, 1, false);
+	SpeedCurveHandles.RemoveAt(LastSlot, 1, false);
+	ZMultiplierCurveHandles.RemoveAt(LastSlot, 1, false);
+	Deterministic.RemoveAt(LastSlot, 1, false);
+	Ended.RemoveAt(LastSlot, 1, false);
+
+	Component->BatchedMotionSlot = INDEX_NONE;
+}
+
+bool UCharacterMotionSubsystem::GetEvaluatedPose(const UMyCharacterMovementComponent* Component, float MotionTime, FVector& OutLocation, FRotator& OutRotation, bool& bOutEnded) const
+{
+	const int32 Slot = Component->BatchedMotionSlot;
+	if (Slot == INDEX_NONE || Streams[EvaluatedTime][Slot] != MotionTime)
+	{
+		return false;
+	}
+
+	OutLocation = FVector(Streams[OutX][Slot], Streams[OutY][Slot], Streams[OutZ][Slot]);
+	OutRotation = FRotator(Streams[OutPitch][Slot], Streams[OutYaw][Slot], Streams[OutRoll][Slot]);
+	bOutEnded = Ended[Slot];
+
+	return true;
+}
+
+MOTION_FP_CONTRACT_OFF
+
+void UCharacterMotionSubsystem::EvaluateMotions(float ServerTime)
+{
+	MOTION_SCOPE_CYCLE_COUNTER(STAT_BatchedMotionEvaluate);
+
+	const int32 NumMotions = Components.Num();
+	if (NumMotions == 0)
+	{
+		return;
+	}
+
+	const FMotionCurveCache& CurveCache = FMotionCurveCache::Get();
+
+	// Time, alpha and curves, same steps as FCharacterMotionData::EvaluatePoseAt
+	for (int32 Slot = 0; Slot < NumMotions; ++Slot)
+	{
+		const float MotionTime = FMath::Max(0.0f, ServerTime - Streams[ServerStartTime][Slot]);
+		const float ClockTime = Deterministic[Slot] ? (float)FMath::RoundToInt(MotionTime * 1000.0f) : MotionTime;
+		const float MoveValue = FMath::Min(1.0f, ClockTime / Streams[ClockDuration][Slot]);
+		const bool bEnded = FMath::IsNearlyEqual(MoveValue, 1.0f);
+
+		float LerpValue = bEnded ? 1.0f : MoveValue;
+		if (!bEnded && SpeedCurveHandles[Slot] != INDEX_NONE)
+		{
+			LerpValue = CurveCache.Evaluate(SpeedCurveHandles[Slot], LerpValue);
+		}
+
+		float ZOffsetValue = 0.0f;
+		if (!bEnded && ZMultiplierCurveHandles[Slot] != INDEX_NONE)
+		{
+			ZOffsetValue = Streams[MaxZOffset][Slot] * CurveCache.Evaluate(ZMultiplierCurveHandles[Slot], LerpValue);
+		}
+
+		Streams[EvaluatedTime][Slot] = MotionTime;
+		Streams[Alpha][Slot] = LerpValue;
+		Streams[ZOffset][Slot] = ZOffsetValue;
+		Ended[Slot] = bEnded;
+	}
+
+	// Start + Delta * Alpha for every motion, VectorWidth motions at a time. Separate multiplies and adds like MotionDeterminism::Lerp,
+	// so that the batched pose is the one the component would evaluate itself.
+	static constexpr EStream LerpStreams[][3] =
+	{
+		{ StartX, DeltaX, OutX },
+		{ StartY, DeltaY, OutY },
+		{ StartZ, DeltaZ, OutZ },
+		{ StartPitch, DeltaPitch, OutPitch },
+		{ StartYaw, DeltaYaw, OutYaw },
+		{ StartRoll, DeltaRoll, OutRoll },
+	};
+
+	for (int32 Slot = 0; Slot < NumMotions; Slot += VectorWidth)
+	{
+		const VectorRegister AlphaValues = VectorLoadAligned(&Streams[Alpha][Slot]);
+
+		for (const EStream* Lerp : LerpStreams)
+		{
+			const VectorRegister StartValues = VectorLoadAligned(&Streams[Lerp[0]][Slot]);
+			const VectorRegister DeltaValues = VectorLoadAligned(&Streams[Lerp[1]][Slot]);
+			VectorStoreAligned(VectorAdd(StartValues, VectorMultiply(DeltaValues, AlphaValues)), &Streams[Lerp[2]][Slot]);
+		}
+
+		const VectorRegister OutZValues = VectorLoadAligned(&Streams[OutZ][Slot]);
+		VectorStoreAligned(VectorAdd(OutZValues, VectorLoadAligned(&Streams[ZOffset][Slot])), &Streams[OutZ][Slot]);
+	}
+}
+
+MOTION_FP_CONTRACT_RESTORE
+
+void UCharacterMotionSubsystem::OnWorldPreActorTick(UWorld* InWorld, ELevelTick TickType, float DeltaSeconds)
+{
+	if (InWorld != GetWorld() || CharacterMotionSubsystemCVars::EnableBatchedMotion == 0)
+	{
+		return;
+	}
+
+	// The world time is already advanced to this frame, proxies read the same server time when they tick
+	const AGameStateBase* GameState = InWorld->GetGameState();
+	EvaluateMotions(GameState ? GameState->GetServerWorldTimeSeconds() : InWorld->GetTimeSeconds());
+}
@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "CharacterMotionSubsystem.generated.h"
+
+class UMyCharacterMovementComponent;
+
+/**
+ * Keeps the replicated motions of full LOD simulated proxies in structure of arrays form and evaluates all of them in a single
+ * vectorized pass before actors tick. Proxies evaluate their motion at the server world time minus its start time, which is known
+ * for the whole frame before they tick, so SimulateMovement uses the batched pose whenever it was evaluated at that same time.
+ * Only linear trajectories are batched, splines and the interval poses of lower LODs are evaluated by the component.
+ */
+UCLASS()
+class MYPROJECT_API UCharacterMotionSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	/* Dedicated servers have no simulated proxies */
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	/* Adds the replicated motion of a component, or refreshes it if it is already there */
+	void AddOrUpdateMotion(UMyCharacterMovementComponent* Component);
+	void RemoveMotion(UMyCharacterMovementComponent* Component);
+
+	/* Returns the pose evaluated by the last batch if it was evaluated at the given motion time of the component */
+	bool GetEvaluatedPose(const UMyCharacterMovementComponent* Component, float MotionTime, FVector& OutLocation, FRotator& OutRotation, bool& bOutEnded) const;
+
+	/* Evaluates the pose of every motion at the given server world time */
+	void EvaluateMotions(float ServerTime);
+
+	int32 GetNumMotions() const { return Components.Num(); }
+
+private:
+
+	void OnWorldPreActorTick(UWorld* InWorld, ELevelTick TickType, float DeltaSeconds);
+
+	enum EStream
+	{
+		StartX, StartY, StartZ,
+		DeltaX, DeltaY, DeltaZ,
+		StartPitch, StartYaw, StartRoll,
+		DeltaPitch, DeltaYaw, DeltaRoll,
+		ServerStartTime, ClockDuration, MaxZOffset,
+		EvaluatedTime, Alpha, ZOffset,
+		OutX, OutY, OutZ,
+		OutPitch, OutYaw, OutRoll,
+		NumStreams
+	};
+
+	// Streams are padded to a multiple of the vector width, padding elements are zero
+	static constexpr int32 VectorWidth = 4;
+
+	using FStream = TArray<float, TAlignedHeapAllocator<16>>;
+
+	TArray<UMyCharacterMovementComponent*> Components;
+	FStream Streams[NumStreams];
+	TArray<int32> SpeedCurveHandles;
+	TArray<int32> ZMultiplierCurveHandles;
+	TArray<bool> Deterministic;
+	TArray<bool> Ended;
+
+	FDelegateHandle PreActorTickHandle;
+};
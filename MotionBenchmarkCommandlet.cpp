@@ -0,0 +1,437 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MotionBenchmarkCommandlet.h"
+#include "MyCharacterMovementComponent.h"
+#include "MyProjectCharacter.h"
+#include "MotionNetSerialization.h"
+#include "Algo/Count.h"
+#include "Curves/CurveFloat.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/BitReader.h"
+#include "Serialization/BitWriter.h"
+
+namespace MotionBenchmark
+{
+	constexpr int32 DefaultIterations = 100000;
+	constexpr int32 WarmupIterations = 1000;
+
+	// Replay runs over a recorded motion of ReplayMoves moves of ReplayDeltaTime
+	constexpr int32 ReplayMoves = 60;
+	constexpr float ReplayDeltaTime = 1.0f / 60.0f;
+
+	// Keeps the optimizer from dropping evaluation results
+	volatile float Sink = 0.0f;
+
+	/* Forwards to the allocator it replaces and counts the allocations made from the game thread */
+	class FAllocationCounter final : public FMalloc
+	{
+	public:
+
+		explicit FAllocationCounter(FMalloc* InInner)
+			: Inner(InInner)
+		{
+		}
+
+		virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+		{
+			CountAllocation();
+			return Inner->Malloc(Count, Alignment);
+		}
+
+		virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			if (Count > 0)
+			{
+				CountAllocation();
+			}
+			return Inner->Realloc(Original, Count, Alignment);
+		}
+
+		virtual void Free(void* Original) override { Inner->Free(Original); }
+		virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return Inner->QuantizeSize(Count, Alignment); }
+		virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return Inner->GetAllocationSize(Original, SizeOut); }
+		virtual void Trim(bool bTrimThreadCaches) override { Inner->Trim(bTrimThreadCaches); }
+		virtual void SetupTLSCachesOnCurrentThread() override { Inner->SetupTLSCachesOnCurrentThread(); }
+		virtual void ClearAndDisableTLSCachesOnCurrentThread() override { Inner->ClearAndDisableTLSCachesOnCurrentThread(); }
+		virtual bool IsInternallyThreadSafe() const override { return Inner->IsInternallyThreadSafe(); }
+		virtual bool ValidateHeap() override { return Inner->ValidateHeap(); }
+		virtual const TCHAR* GetDescriptiveName() override { return Inner->GetDescriptiveName(); }
+
+		int64 GetNumAllocations() const { return NumAllocations; }
+
+	private:
+
+		void CountAllocation()
+		{
+			if (IsInGameThread())
+			{
+				++NumAllocations;
+			}
+		}
+
+		FMalloc* Inner;
+		int64 NumAllocations = 0;
+	};
+
+	/* Installs an allocation counter as GMalloc for its lifetime */
+	class FScopedAllocationCounter
+	{
+	public:
+
+		FScopedAllocationCounter()
+			: Counter(GMalloc)
+			, Previous(GMalloc)
+		{
+			GMalloc = &Counter;
+		}
+
+		~FScopedAllocationCounter()
+		{
+			GMalloc = Previous;
+		}
+
+		int64 GetNumAllocations() const { return Counter.GetNumAllocations(); }
+
+	private:
+
+		FAllocationCounter Counter;
+		FMalloc* Previous;
+	};
+
+	double ToNanoseconds(uint64 Cycles)
+	{
+		return FPlatformTime::GetSecondsPerCycle64() * (double)Cycles * 1.0e9;
+	}
+}
+
+UMotionBenchmarkCommandlet::UMotionBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UMotionBenchmarkCommandlet::Main(const FString& Params)
+{
+	int32 Iterations = MotionBenchmark::DefaultIterations;
+	FParse::Value(*Params, TEXT("Iterations="), Iterations);
+	Iterations = FMath::Max(1, Iterations);
+
+	FString OutputPath = FPaths::ProjectSavedDir() / TEXT("Benchmarks") / TEXT("MotionBenchmark.json");
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+
+	UCurveFloat* SpeedCurve = MakeCurve({ FVector2D(0.0f, 0.0f), FVector2D(0.3f, 0.6f), FVector2D(1.0f, 1.0f) });
+	UCurveFloat* ZMultiplierCurve = MakeCurve({ FVector2D(0.0f, 0.0f), FVector2D(0.5f, 1.0f), FVector2D(1.0f, 0.0f) });
+
+	TArray<FResult> Results;
+	Results.Add(BenchmarkEvaluation(TEXT("EvaluateLinear"), nullptr, nullptr, Iterations));
+	Results.Add(BenchmarkEvaluation(TEXT("EvaluateSpeedCurve"), SpeedCurve, nullptr, Iterations));
+	Results.Add(BenchmarkEvaluation(TEXT("EvaluateSpeedAndZCurves"), SpeedCurve, ZMultiplierCurve, Iterations));
+	Results.Add(BenchmarkEvaluation(TEXT("EvaluateSpline"), SpeedCurve, ZMultiplierCurve, Iterations, FCharacterMotionData::MaxControlPoints));
+	Results.Add(BenchmarkMotionSerialization(Iterations));
+
+	// Move serialization and replay need a character with a registered movement component
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false, TEXT("MotionBenchmarkWorld"));
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	AMyProjectCharacter* Character = World->SpawnActor<AMyProjectCharacter>(FVector(0.0f, 0.0f, 100.0f), FRotator::ZeroRotator, SpawnParameters);
+	UMyCharacterMovementComponent* MoveComp = Character ? Cast<UMyCharacterMovementComponent>(Character->GetCharacterMovement()) : nullptr;
+
+	bool bStartedMotion = false;
+	if (MoveComp)
+	{
+		// Motions can only use curves from the preset registry manifest, the transient curves above are not in it.
+		// Curve evaluation is measured by the Evaluate benchmarks already.
+		FCharacterMotionData MotionData(Character->GetActorLocation(), Character->GetActorLocation() + FVector(600.0f, 0.0f, 0.0f), FRotator::ZeroRotator, FRotator(0.0f, 90.0f, 0.0f), 2);
+		MoveComp->StartMotion(MotionData);
+		bStartedMotion = MoveComp->GetCurrentMotionData().HasValidData();
+	}
+
+	if (bStartedMotion)
+	{
+		Results.Add(BenchmarkReplay(*MoveComp, FMath::Max(1, Iterations / MotionBenchmark::ReplayMoves)));
+		Results.Add(BenchmarkMoveSerialization(*MoveComp, Iterations));
+	}
+	else
+	{
+		UE_LOG(LogTemp, Error, TEXT("UMotionBenchmarkCommandlet - could not spawn a character or start its motion, skipping move serialization and replay"));
+	}
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+
+	bool bFailed = !bStartedMotion;
+	for (const FResult& Result : Results)
+	{
+		UE_LOG(LogTemp, Display, TEXT("%-28s %10.1f ns/op %8.1f bits/op %6.2f allocs/op%s"), *Result.Name, Result.NanosecondsPerOp, Result.BitsPerOp, Result.AllocationsPerOp, Result.bFailed ? TEXT(" FAILED") : TEXT(""));
+		bFailed |= Result.bFailed;
+	}
+
+	if (!WriteResults(Results, OutputPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("UMotionBenchmarkCommandlet - could not write %s"), *OutputPath);
+		return 1;
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("UMotionBenchmarkCommandlet - results written to %s"), *OutputPath);
+	return bFailed ? 1 : 0;
+}
+
+UMotionBenchmarkCommandlet::FResult UMotionBenchmarkCommandlet::BenchmarkEvaluation(const TCHAR* Name, UCurveFloat* SpeedCurve, UCurveFloat* ZMultiplierCurve, int32 Iterations, int32 NumControlPoints) const
+{
+	FCharacterMotionData MotionData(FVector::ZeroVector, FVector(600.0f, 0.0f, 0.0f), FRotator::ZeroRotator, FRotator(0.0f, 90.0f, 0.0f), 2);
+	MotionData.MovementSpeedCurve = SpeedCurve;
+	MotionData.MovementZMultiplierCurve = ZMultiplierCurve;
+	MotionData.MaxZOffset = 120;
+
+	// Zigzag between the start and the target
+	for (int32 Index = 0; Index < NumControlPoints; ++Index)
+	{
+		MotionData.AddControlPoint(FVector(600.0f * (Index + 1) / (NumControlPoints + 1), Index % 2 == 0 ? 150.0f : -150.0f, 0.0f));
+	}
+	MotionData.BakeCurves();
+
+	// Times spread over the whole motion, end excluded
+	constexpr int32 NumTimes = 64;
+	const float TimeStep = (float)MotionData.Duration / NumTimes;
+
+	auto Evaluate = [&MotionData, TimeStep](int32 Iteration)
+	{
+		FVector Location;
+		FRotator Rotation;
+		MotionData.EvaluatePoseAt((Iteration % NumTimes) * TimeStep, Location, Rotation);
+		MotionBenchmark::Sink += Location.Z + Rotation.Yaw;
+	};
+
+	for (int32 Iteration = 0; Iteration < MotionBenchmark::WarmupIterations; ++Iteration)
+	{
+		Evaluate(Iteration);
+	}
+
+	FResult Result;
+	Result.Name = Name;
+	Result.Iterations = Iterations;
+
+	MotionBenchmark::FScopedAllocationCounter AllocationCounter;
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+	{
+		Evaluate(Iteration);
+	}
+
+	Result.NanosecondsPerOp = MotionBenchmark::ToNanoseconds(FPlatformTime::Cycles64() - StartCycles) / Iterations;
+	Result.AllocationsPerOp = (double)AllocationCounter.GetNumAllocations() / Iterations;
+	return Result;
+}
+
+UMotionBenchmarkCommandlet::FResult UMotionBenchmarkCommandlet::BenchmarkMotionSerialization(int32 Iterations) const
+{
+	const FVector MoveLocation(1234.5f, -678.9f, 100.0f);
+	const FIntVector Origin = MotionNetSerialization::GetMoveOrigin(MoveLocation, false);
+
+	// Curves only add their manifest index bytes and are not part of the measure
+	FCharacterMotionData SourceMotionData(MoveLocation, MoveLocation + FVector(600.0f, 250.0f, 0.0f), FRotator(0.0f, 45.0f, 0.0f), FRotator(0.0f, 135.0f, 0.0f), 2);
+	SourceMotionData.MaxZOffset = 120;
+
+	FBitWriter Writer(MotionNetSerialization::MaxMoveMotionBits, true);
+	int64 TotalBits = 0;
+
+	auto RoundTrip = [&](FCharacterMotionData& ReceivedMotionData)
+	{
+		bool bSuccess = true;
+		Writer.Reset();
+		TotalBits += MotionNetSerialization::SerializeMotion(Writer, nullptr, SourceMotionData, Origin, bSuccess);
+
+		FBitReader Reader(Writer.GetData(), Writer.GetNumBits());
+		MotionNetSerialization::SerializeMotion(Reader, nullptr, ReceivedMotionData, Origin, bSuccess);
+		return bSuccess;
+	};
+
+	FCharacterMotionData ReceivedMotionData;
+	for (int32 Iteration = 0; Iteration < MotionBenchmark::WarmupIterations; ++Iteration)
+	{
+		RoundTrip(ReceivedMotionData);
+	}
+
+	FResult Result;
+	Result.Name = TEXT("MotionSerializeRoundTrip");
+	Result.Iterations = Iterations;
+
+	if (ReceivedMotionData.Duration != SourceMotionData.Duration || !ReceivedMotionData.TargetLocation.Equals(SourceMotionData.TargetLocation, 1.0f))
+	{
+		UE_LOG(LogTemp, Error, TEXT("UMotionBenchmarkCommandlet - motion round trip does not match the source motion"));
+		Result.bFailed = true;
+	}
+
+	TotalBits = 0;
+
+	MotionBenchmark::FScopedAllocationCounter AllocationCounter;
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+	{
+		RoundTrip(ReceivedMotionData);
+	}
+
+	Result.NanosecondsPerOp = MotionBenchmark::ToNanoseconds(FPlatformTime::Cycles64() - StartCycles) / Iterations;
+	Result.BitsPerOp = (double)TotalBits / Iterations;
+	Result.AllocationsPerOp = (double)AllocationCounter.GetNumAllocations() / Iterations;
+	return Result;
+}
+
+UMotionBenchmarkCommandlet::FResult UMotionBenchmarkCommandlet::BenchmarkMoveSerialization(UMyCharacterMovementComponent& MoveComp, int32 Iterations) const
+{
+	FCharacterNetworkMoveData_Custom SentMoveData;
+	SentMoveData.TimeStamp = 12.5f;
+	SentMoveData.Acceleration = FVector(0.0f, 0.0f, 0.0f);
+	SentMoveData.Location = MoveComp.GetActorLocation();
+	SentMoveData.ControlRotation = FRotator(0.0f, 90.0f, 0.0f);
+	SentMoveData.MovementMode = MOVE_Custom;
+	SentMoveData.bMotionDataValid = true;
+	SentMoveData.LatestMotionSequence = MoveComp.NextMotionSequence;
+
+	FCharacterNetworkMoveData_Custom ReceivedMoveData;
+	FBitWriter Writer(1024, true);
+	int64 TotalBits = 0;
+
+	auto RoundTrip = [&]()
+	{
+		Writer.Reset();
+		SentMoveData.Serialize(MoveComp, Writer, nullptr, FCharacterNetworkMoveData::ENetworkMoveType::NewMove);
+		TotalBits += Writer.GetNumBits();
+
+		FBitReader Reader(Writer.GetData(), Writer.GetNumBits());
+		ReceivedMoveData.Serialize(MoveComp, Reader, nullptr, FCharacterNetworkMoveData::ENetworkMoveType::NewMove);
+	};
+
+	for (int32 Iteration = 0; Iteration < MotionBenchmark::WarmupIterations; ++Iteration)
+	{
+		RoundTrip();
+	}
+
+	FResult Result;
+	Result.Name = TEXT("MoveSerializeRoundTrip");
+	Result.Iterations = Iterations;
+
+	if (ReceivedMoveData.NetMotions.Num() == 0)
+	{
+		// Only the motion count would be measured
+		UE_LOG(LogTemp, Error, TEXT("UMotionBenchmarkCommandlet - the move round trip carried no motion"));
+		Result.bFailed = true;
+	}
+
+	TotalBits = 0;
+
+	MotionBenchmark::FScopedAllocationCounter AllocationCounter;
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+	{
+		RoundTrip();
+	}
+
+	Result.NanosecondsPerOp = MotionBenchmark::ToNanoseconds(FPlatformTime::Cycles64() - StartCycles) / Iterations;
+	Result.BitsPerOp = (double)TotalBits / Iterations;
+	Result.AllocationsPerOp = (double)AllocationCounter.GetNumAllocations() / Iterations;
+	return Result;
+}
+
+UMotionBenchmarkCommandlet::FResult UMotionBenchmarkCommandlet::BenchmarkReplay(UMyCharacterMovementComponent& MoveComp, int32 Iterations) const
+{
+	ACharacter* Character = MoveComp.GetCharacterOwner();
+	FNetworkPredictionData_Client_Character* ClientData = MoveComp.GetPredictionData_Client_Character();
+	const FVector StartLocation = Character->GetActorLocation();
+
+	// Record the moves of the motion the way the client does before sending them
+	ClientData->SavedMoves.Reset();
+	for (int32 MoveIndex = 0; MoveIndex < MotionBenchmark::ReplayMoves; ++MoveIndex)
+	{
+		FSavedMovePtr SavedMove = ClientData->CreateSavedMove();
+		if (!SavedMove.IsValid())
+		{
+			break;
+		}
+
+		SavedMove->SetMoveFor(Character, MotionBenchmark::ReplayDeltaTime, FVector::ZeroVector, *ClientData);
+		SavedMove->TimeStamp = (MoveIndex + 1) * MotionBenchmark::ReplayDeltaTime;
+		MoveComp.PerformMovement(MotionBenchmark::ReplayDeltaTime);
+		SavedMove->PostUpdate(Character, FSavedMove_Character::PostUpdate_Record);
+		ClientData->SavedMoves.Push(SavedMove);
+	}
+
+	const int32 NumMoves = ClientData->SavedMoves.Num();
+	const int32 NumMotionMoves = Algo::CountIf(ClientData->SavedMoves, [](const FSavedMovePtr& SavedMove) { return static_cast<const FSavedMove_Character_Custom*>(SavedMove.Get())->SavedMotionData.bIsActive; });
+
+	// Same state as after a correction: back at the start with the motion stopped, then every saved move replayed
+	auto Replay = [&]()
+	{
+		Character->SetActorLocation(StartLocation, false, nullptr, ETeleportType::TeleportPhysics);
+		MoveComp.MotionData.Stop();
+		ClientData->bUpdatePosition = true;
+		MoveComp.ClientUpdatePositionAfterServerUpdate();
+	};
+
+	for (int32 Iteration = 0; Iteration < MotionBenchmark::WarmupIterations / NumMoves + 1; ++Iteration)
+	{
+		Replay();
+	}
+
+	FResult Result;
+	Result.Name = TEXT("ReplaySavedMove");
+	Result.Iterations = Iterations * NumMoves;
+
+	if (NumMotionMoves < NumMoves)
+	{
+		// The motion must cover every recorded move, otherwise part of the replay is plain walking
+		UE_LOG(LogTemp, Error, TEXT("UMotionBenchmarkCommandlet - only %d of the %d replayed moves carry a motion"), NumMotionMoves, NumMoves);
+		Result.bFailed = true;
+	}
+
+	MotionBenchmark::FScopedAllocationCounter AllocationCounter;
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+	{
+		Replay();
+	}
+
+	Result.NanosecondsPerOp = MotionBenchmark::ToNanoseconds(FPlatformTime::Cycles64() - StartCycles) / FMath::Max(1, Result.Iterations);
+	Result.AllocationsPerOp = (double)AllocationCounter.GetNumAllocations() / FMath::Max(1, Result.Iterations);
+	return Result;
+}
+
+UCurveFloat* UMotionBenchmarkCommandlet::MakeCurve(const TArray<FVector2D>& Keys)
+{
+	UCurveFloat* Curve = NewObject<UCurveFloat>(GetTransientPackage());
+	for (const FVector2D& Key : Keys)
+	{
+		const FKeyHandle KeyHandle = Curve->FloatCurve.AddKey(Key.X, Key.Y);
+		Curve->FloatCurve.SetKeyInterpMode(KeyHandle, RCIM_Cubic);
+	}
+	return Curve;
+}
+
+bool UMotionBenchmarkCommandlet::WriteResults(const TArray<FResult>& Results, const FString& OutputPath)
+{
+	FString Json = TEXT("{\n\t\"benchmarks\": [\n");
+	for (int32 ResultIndex = 0; ResultIndex < Results.Num(); ++ResultIndex)
+	{
+		const FResult& Result = Results[ResultIndex];
+		Json += FString::Printf(TEXT("\t\t{ \"name\": \"%s\", \"iterations\": %d, \"ns_per_op\": %.2f, \"bits_per_op\": %.2f, \"allocs_per_op\": %.4f, \"failed\": %s }%s\n"),
+			*Result.Name, Result.Iterations, Result.NanosecondsPerOp, Result.BitsPerOp, Result.AllocationsPerOp, Result.bFailed ? TEXT("true") : TEXT("false"), ResultIndex + 1 < Results.Num() ? TEXT(",") : TEXT(""));
+	}
+	Json += TEXT("\t]\n}\n");
+
+	IFileManager::Get().MakeDirectory(*FPaths::GetPath(OutputPath), true);
+	return FFileHelper::SaveStringToFile(Json, *OutputPath);
+}
@@ -0,0 +1,50 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "MotionBenchmarkCommandlet.generated.h"
+
+class UCurveFloat;
+class UMyCharacterMovementComponent;
+
+/**
+ * Times the motion hot paths outside of a game session: pose evaluation, motion and move serialization round trips,
+ * and saved move replay. Results are written as JSON with ns/op, bits/op and allocations/op for each benchmark.
+ *
+ * UE4Editor-Cmd MyProject -run=MotionBenchmark [-Iterations=N] [-Output=Path] -nullrhi -unattended
+ */
+UCLASS()
+class UMotionBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+
+	UMotionBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+
+	struct FResult
+	{
+		FString Name;
+		int32 Iterations = 0;
+		double NanosecondsPerOp = 0.0;
+		double BitsPerOp = 0.0;
+		double AllocationsPerOp = 0.0;
+
+		// Set when the benchmark did not measure what it is meant to, the commandlet then fails
+		bool bFailed = false;
+	};
+
+	FResult BenchmarkEvaluation(const TCHAR* Name, UCurveFloat* SpeedCurve, UCurveFloat* ZMultiplierCurve, int32 Iterations, int32 NumControlPoints = 0) const;
+	FResult BenchmarkMotionSerialization(int32 Iterations) const;
+	FResult BenchmarkMoveSerialization(UMyCharacterMovementComponent& MoveComp, int32 Iterations) const;
+	FResult BenchmarkReplay(UMyCharacterMovementComponent& MoveComp, int32 Iterations) const;
+
+	static UCurveFloat* MakeCurve(const TArray<FVector2D>& Keys);
+	static bool WriteResults(const TArray<FResult>& Results, const FString& OutputPath);
+};
@@ -0,0 +1,214 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MotionCurveCache.h"
+#include "Curves/CurveFloat.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "UObject/UObjectGlobals.h"
+
+namespace MotionCurveCacheCVars
+{
+	float MaxBakeError = 0.001f;
+	FAutoConsoleVariableRef CVarMaxBakeError(
+		TEXT("p.MotionCurveMaxBakeError"),
+		MaxBakeError,
+		TEXT("Largest difference allowed between a baked motion curve and its source curve.\n")
+		TEXT("Curves are baked at the lowest resolution meeting this bound, up to 256 segments."),
+		ECVF_Default);
+
+	// Lowest resolution tried when baking a curve, doubled until the error bound is met
+	constexpr int32 MinResolution = 32;
+
+	// Number of points measured inside each segment to estimate the bake error
+	constexpr int32 ErrorSubSamples = 4;
+}
+
+FMotionCurveCache::FMotionCurveCache()
+{
+	FWorldDelegates::OnWorldCleanup.AddRaw(this, &FMotionCurveCache::OnWorldCleanup);
+#if WITH_EDITOR
+	FCoreUObjectDelegates::OnObjectModified.AddRaw(this, &FMotionCurveCache::OnObjectModified);
+	FCoreUObjectDelegates::OnObjectPropertyChanged.AddRaw(this, &FMotionCurveCache::OnObjectPropertyChanged);
+#endif
+}
+
+FMotionCurveCache& FMotionCurveCache::Get()
+{
+	static FMotionCurveCache Instance;
+	return Instance;
+}
+
+int32 FMotionCurveCache::FindOrBake(const UCurveFloat* Curve)
+{
+	if (Curve == nullptr)
+	{
+		return INDEX_NONE;
+	}
+
+	check(IsInGameThread());
+
+	if (const int32* ExistingHandle = HandleByCurve.Find(Curve))
+	{
+#if WITH_EDITOR
+		if (DirtyHandles.Remove(*ExistingHandle) > 0)
+		{
+			// Baked again in place, so that the motions holding the handle follow the edit
+			Bake(*Curve, BakedCurves[*ExistingHandle]);
+		}
+#endif
+		return *ExistingHandle;
+	}
+
+	// Only new curves pay for the sweep, their slot can come from a curve that was garbage collected
+	EvictStaleCurves();
+
+	const int32 Handle = FreeHandles.Num() > 0 ? FreeHandles.Pop(false) : BakedCurves.AddDefaulted();
+	Bake(*Curve, BakedCurves[Handle]);
+	HandleByCurve.Add(Curve, Handle);
+
+	return Handle;
+}
+
+int32 FMotionCurveCache::FindOrBakePinned(const UCurveFloat* Curve)
+{
+	const int32 Handle = FindOrBake(Curve);
+	if (Handle != INDEX_NONE)
+	{
+		PinnedHandles.Add(Handle);
+	}
+	return Handle;
+}
+
+void FMotionCurveCache::Reset()
+{
+	if (PinnedHandles.Num() == 0)
+	{
+		HandleByCurve.Reset();
+		BakedCurves.Reset();
+		FreeHandles.Reset();
+#if WITH_EDITOR
+		DirtyHandles.Reset();
+#endif
+		return;
+	}
+
+	// The pinned curves were baked ahead of any motion, they keep their handle so that motions never bake them again
+	for (auto It = HandleByCurve.CreateIterator(); It; ++It)
+	{
+		if (!It.Key().IsValid() || !PinnedHandles.Contains(It.Value()))
+		{
+			FreeHandle(It.Value());
+			It.RemoveCurrent();
+		}
+	}
+}
+
+void FMotionCurveCache::EvictStaleCurves()
+{
+	for (auto It = HandleByCurve.CreateIterator(); It; ++It)
+	{
+		if (!It.Key().IsValid())
+		{
+			FreeHandle(It.Value());
+			It.RemoveCurrent();
+		}
+	}
+}
+
+void FMotionCurveCache::FreeHandle(int32 Handle)
+{
+#if WITH_EDITOR
+	DirtyHandles.Remove(Handle);
+#endif
+	PinnedHandles.Remove(Handle);
+	FreeHandles.Add(Handle);
+}
+
+void FMotionCurveCache::OnWorldCleanup(UWorld* World, bool bSessionEnded, bool bCleanupResources)
+{
+	// Motions of the other game worlds, such as other PIE instances, still hold their handles
+	if (GEngine)
+	{
+		for (const FWorldContext& WorldContext : GEngine->GetWorldContexts())
+		{
+			const UWorld* OtherWorld = WorldContext.World();
+			if (OtherWorld && OtherWorld != World && OtherWorld->IsGameWorld())
+			{
+				EvictStaleCurves();
+				return;
+			}
+		}
+	}
+
+	Reset();
+}
+
+#if WITH_EDITOR
+void FMotionCurveCache::OnObjectModified(UObject* Object)
+{
+	// Sent before the edit is applied, the curve is baked when it is looked up next
+	if (const int32* Handle = Object && Object->IsA<UCurveFloat>() ? HandleByCurve.Find(CastChecked<UCurveFloat>(Object)) : nullptr)
+	{
+		DirtyHandles.Add(*Handle);
+	}
+}
+
+void FMotionCurveCache::OnObjectPropertyChanged(UObject* Object, FPropertyChangedEvent& PropertyChangedEvent)
+{
+	OnObjectModified(Object);
+}
+#endif
+
+// Clients and servers bake the curves of deterministic motions on their own. The samples are snapped to a fixed grid,
+// UCurveFloat is compiled with contraction and can be an ulp off between builds.
+MOTION_FP_CONTRACT_OFF
+
+void FMotionCurveCache::Bake(const UCurveFloat& Curve, FBakedMotionCurve& OutBakedCurve)
+{
+	using namespace MotionCurveCacheCVars;
+
+	float MinTime = 0.0f;
+	float MaxTime = 0.0f;
+	Curve.GetTimeRange(MinTime, MaxTime);
+
+	const float Range = FMath::Max(0.0f, MaxTime - MinTime);
+
+	for (int32 Resolution = MinResolution; ; Resolution *= 2)
+	{
+		const float Step = Range / Resolution;
+		for (int32 SampleIndex = 0; SampleIndex <= Resolution; ++SampleIndex)
+		{
+			OutBakedCurve.Samples[SampleIndex] = MotionDeterminism::SnapToGrid(Curve.GetFloatValue(MinTime + Step * SampleIndex));
+		}
+		OutBakedCurve.Samples[Resolution + 1] = OutBakedCurve.Samples[Resolution];
+
+		OutBakedCurve.MinTime = MinTime;
+		OutBakedCurve.InvStep = Range > 0.0f ? Resolution / Range : 0.0f;
+		OutBakedCurve.LastPosition = (float)Resolution;
+		OutBakedCurve.Resolution = Resolution;
+
+		float MaxError = 0.0f;
+		for (int32 SegmentIndex = 0; SegmentIndex < Resolution; ++SegmentIndex)
+		{
+			for (int32 SubSample = 1; SubSample < ErrorSubSamples; ++SubSample)
+			{
+				const float Time = MinTime + Step * (SegmentIndex + (float)SubSample / ErrorSubSamples);
+				MaxError = FMath::Max(MaxError, FMath::Abs(OutBakedCurve.Evaluate(Time) - Curve.GetFloatValue(Time)));
+			}
+		}
+		OutBakedCurve.MaxError = MaxError;
+
+		if (MaxError <= MaxBakeError)
+		{
+			break;
+		}
+
+		if (Resolution * 2 > FBakedMotionCurve::MaxResolution)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("FMotionCurveCache - curve %s baked with an error of %f, above p.MotionCurveMaxBakeError (%f)"), *Curve.GetPathName(), MaxError, MaxBakeError);
+			break;
+		}
+	}
+}
+
+MOTION_FP_CONTRACT_RESTORE
@@ -0,0 +1,94 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/ContainerAllocationPolicies.h"
+#include "UObject/WeakObjectPtrTemplates.h"
+#include "MotionDeterminism.h"
+
+class UCurveFloat;
+class UWorld;
+
+/**
+ * A UCurveFloat sampled into a fixed-size table so that it can be evaluated with a single indexed lerp.
+ * The table covers the key time range of the source curve and clamps outside of it (constant extrapolation).
+ */
+MOTION_FP_CONTRACT_OFF
+struct alignas(PLATFORM_CACHE_LINE_SIZE) FBakedMotionCurve
+{
+	/* Largest number of segments a curve can be baked with */
+	static constexpr int32 MaxResolution = 256;
+
+	float Evaluate(float InTime) const
+	{
+		const float Position = FMath::Clamp((InTime - MinTime) * InvStep, 0.0f, LastPosition);
+		const int32 Index = (int32)Position;
+		return MotionDeterminism::Lerp(Samples[Index], Samples[Index + 1], Position - (float)Index);
+	}
+
+	float MinTime = 0.0f;
+	float InvStep = 0.0f;
+	float LastPosition = 0.0f;
+
+	/* Number of segments in the table and the largest difference measured against the source curve when baking */
+	int32 Resolution = 0;
+	float MaxError = 0.0f;
+
+	// Resolution + 1 samples, plus a copy of the last one so that evaluating exactly at the end never reads out of bounds
+	float Samples[MaxResolution + 2];
+};
+MOTION_FP_CONTRACT_RESTORE
+
+/**
+ * Game thread cache of baked motion curves.
+ * Curves are baked the first time they are referenced and then addressed by handle, which stays valid until Reset() or until
+ * its curve is garbage collected. The cache is reset when the last game world is cleaned up, except for the pinned curves that
+ * stay loaded for the whole session. Curves edited in the editor are baked again the next time they are looked up.
+ */
+class MYPROJECT_API FMotionCurveCache
+{
+public:
+
+	FMotionCurveCache();
+
+	static FMotionCurveCache& Get();
+
+	/* Returns the handle of the baked version of Curve, baking it if needed. Returns INDEX_NONE for a null curve. */
+	int32 FindOrBake(const UCurveFloat* Curve);
+
+	/* Same as FindOrBake, and keeps the curve baked with the same handle across Reset() until it is garbage collected */
+	int32 FindOrBakePinned(const UCurveFloat* Curve);
+
+	float Evaluate(int32 Handle, float InTime) const
+	{
+		return BakedCurves[Handle].Evaluate(InTime);
+	}
+
+	/* Drops every baked curve but the pinned ones. Other handles acquired before this call must not be used anymore. */
+	void Reset();
+
+private:
+
+	static void Bake(const UCurveFloat& Curve, FBakedMotionCurve& OutBakedCurve);
+
+	/* Frees the handles of the curves that were garbage collected */
+	void EvictStaleCurves();
+
+	void FreeHandle(int32 Handle);
+
+	void OnWorldCleanup(UWorld* World, bool bSessionEnded, bool bCleanupResources);
+
+#if WITH_EDITOR
+	void OnObjectModified(UObject* Object);
+	void OnObjectPropertyChanged(UObject* Object, struct FPropertyChangedEvent& PropertyChangedEvent);
+
+	// Handles of the curves edited since they were baked
+	TSet<int32> DirtyHandles;
+#endif
+
+	TMap<TWeakObjectPtr<const UCurveFloat>, int32> HandleByCurve;
+	TArray<FBakedMotionCurve, TAlignedHeapAllocator<PLATFORM_CACHE_LINE_SIZE>> BakedCurves;
+	TArray<int32> FreeHandles;
+	TSet<int32> PinnedHandles;
+};
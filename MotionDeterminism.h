@@ -0,0 +1,64 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Code between MOTION_FP_CONTRACT_OFF and MOTION_FP_CONTRACT_RESTORE is compiled without contracting a multiply and an add
+ * into a fused multiply-add, which rounds once instead of twice and would make clients and servers built for different
+ * targets disagree on the same pose. It only applies to the code written in between, not to the engine functions it calls.
+ */
+#if defined(__clang__)
+	#define MOTION_FP_CONTRACT_OFF _Pragma("STDC FP_CONTRACT OFF")
+	#define MOTION_FP_CONTRACT_RESTORE _Pragma("STDC FP_CONTRACT DEFAULT")
+#elif defined(_MSC_VER)
+	#define MOTION_FP_CONTRACT_OFF __pragma(float_control(precise, on, push)) __pragma(fp_contract(off))
+	#define MOTION_FP_CONTRACT_RESTORE __pragma(float_control(pop))
+#elif defined(__GNUC__)
+	#define MOTION_FP_CONTRACT_OFF _Pragma("GCC push_options") _Pragma("GCC optimize(\"fp-contract=off\")")
+	#define MOTION_FP_CONTRACT_RESTORE _Pragma("GCC pop_options")
+#else
+	#define MOTION_FP_CONTRACT_OFF
+	#define MOTION_FP_CONTRACT_RESTORE
+#endif
+
+MOTION_FP_CONTRACT_OFF
+
+/* Math of the deterministic motions, written out here rather than calling FMath and FVector, whose bodies are compiled with contraction */
+namespace MotionDeterminism
+{
+	FORCEINLINE float Lerp(float A, float B, float Alpha)
+	{
+		return A + (B - A) * Alpha;
+	}
+
+	FORCEINLINE FVector Lerp(const FVector& A, const FVector& B, float Alpha)
+	{
+		return FVector(Lerp(A.X, B.X, Alpha), Lerp(A.Y, B.Y, Alpha), Lerp(A.Z, B.Z, Alpha));
+	}
+
+	/* Along the shortest path between the rotations, like FMath::Lerp */
+	FORCEINLINE FRotator Lerp(const FRotator& A, const FRotator& B, float Alpha)
+	{
+		const FRotator Delta = (B - A).GetNormalized();
+		return FRotator(A.Pitch + Delta.Pitch * Alpha, A.Yaw + Delta.Yaw * Alpha, A.Roll + Delta.Roll * Alpha);
+	}
+
+	FORCEINLINE float Dist(const FVector& A, const FVector& B)
+	{
+		const float DX = B.X - A.X;
+		const float DY = B.Y - A.Y;
+		const float DZ = B.Z - A.Z;
+		return FMath::Sqrt(DX * DX + DY * DY + DZ * DZ);
+	}
+
+	/* Snaps a value onto a grid of 1/65536, exact for magnitudes below 256, so that one ulp of difference in its source rarely survives */
+	FORCEINLINE float SnapToGrid(float Value)
+	{
+		constexpr float GridScale = 65536.0f;
+		return FMath::RoundToFloat(Value * GridScale) / GridScale;
+	}
+}
+
+MOTION_FP_CONTRACT_RESTORE
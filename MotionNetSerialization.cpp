@@ -0,0 +1,232 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MotionNetSerialization.h"
+#include "MyCharacterMovementComponent.h"
+#include "CharacterMotionPresets.h"
+
+static_assert(MotionNetSerialization::MaxControlPoints == FCharacterMotionData::MaxControlPoints, "The control point count bits do not match the control points of a motion");
+
+namespace MotionNetSerialization
+{
+	static uint32 GetSignedBitCount(int32 Value)
+	{
+		// Bits needed for Value to fit in [-2^(N-1), 2^(N-1)), zero needs none
+		const uint32 Magnitude = Value < 0 ? (uint32)(-(Value + 1)) : (uint32)Value;
+		return Value == 0 ? 0 : FMath::FloorLog2(Magnitude) + 2;
+	}
+
+	FIntVector GetMoveOrigin(const FVector& MoveLocation, bool bIsSaving)
+	{
+		FVector ReceivedLocation = MoveLocation;
+
+		if (bIsSaving)
+		{
+			// FVector_NetQuantize100 sends each component as a rounded number of hundredths
+			ReceivedLocation.X = FMath::RoundToInt(MoveLocation.X * 100.0f) / 100.0f;
+			ReceivedLocation.Y = FMath::RoundToInt(MoveLocation.Y * 100.0f) / 100.0f;
+			ReceivedLocation.Z = FMath::RoundToInt(MoveLocation.Z * 100.0f) / 100.0f;
+		}
+
+		return FIntVector(FMath::RoundToInt(ReceivedLocation.X), FMath::RoundToInt(ReceivedLocation.Y), FMath::RoundToInt(ReceivedLocation.Z));
+	}
+
+	uint32 SerializeLocation(FArchive& Ar, FVector& Location, const FIntVector& Origin)
+	{
+		constexpr int32 MaxDelta = (1 << (MaxDeltaComponentBits - 1)) - 1;
+
+		int32 Delta[3] = { 0, 0, 0 };
+		uint32 ComponentBits = 0;
+
+		if (Ar.IsSaving())
+		{
+			for (int32 Axis = 0; Axis < 3; ++Axis)
+			{
+				Delta[Axis] = FMath::Clamp(FMath::RoundToInt(Location[Axis]) - Origin[Axis], -MaxDelta, MaxDelta);
+				ComponentBits = FMath::Max(ComponentBits, GetSignedBitCount(Delta[Axis]));
+			}
+		}
+
+		Ar.SerializeBits(&ComponentBits, DeltaBitCountBits);
+		ComponentBits = FMath::Min(ComponentBits, MaxDeltaComponentBits);
+
+		if (ComponentBits > 0)
+		{
+			const int32 Bias = 1 << (ComponentBits - 1);
+			for (int32 Axis = 0; Axis < 3; ++Axis)
+			{
+				uint32 Biased = Ar.IsSaving() ? (uint32)(Delta[Axis] + Bias) : 0;
+				Ar.SerializeBits(&Biased, ComponentBits);
+				Delta[Axis] = (int32)Biased - Bias;
+			}
+		}
+
+		if (Ar.IsLoading())
+		{
+			Location = FVector(Origin + FIntVector(Delta[0], Delta[1], Delta[2]));
+		}
+
+		return DeltaBitCountBits + 3 * ComponentBits;
+	}
+
+	uint32 SerializeRotation(FArchive& Ar, FRotator& Rotation)
+	{
+		uint32 Yaw = FRotator::CompressAxisToShort(Rotation.Yaw);
+		uint32 Pitch = FRotator::CompressAxisToShort(Rotation.Pitch);
+		uint32 Roll = FRotator::CompressAxisToByte(Rotation.Roll);
+
+		uint8 bYawOnly = Pitch == 0 && Roll == 0;
+		Ar.SerializeBits(&bYawOnly, 1);
+		Ar.SerializeBits(&Yaw, 16);
+
+		if (!bYawOnly)
+		{
+			Ar.SerializeBits(&Pitch, 16);
+			Ar.SerializeBits(&Roll, 8);
+		}
+
+		if (Ar.IsLoading())
+		{
+			Rotation.Yaw = FRotator::DecompressAxisFromShort((uint16)Yaw);
+			Rotation.Pitch = bYawOnly ? 0.0f : FRotator::DecompressAxisFromShort((uint16)Pitch);
+			Rotation.Roll = bYawOnly ? 0.0f : FRotator::DecompressAxisFromByte((uint8)Roll);
+		}
+
+		return bYawOnly ? 1 + 16 : MaxRotatorBits;
+	}
+
+	void QuantizeMotion(FCharacterMotionData& MotionData)
+	{
+		// Whole units for locations, the target being sent relative to the rounded start rounds the same way
+		auto RoundLocation = [](FVector& Location)
+		{
+			Location = FVector(FMath::RoundToInt(Location.X), FMath::RoundToInt(Location.Y), FMath::RoundToInt(Location.Z));
+		};
+
+		RoundLocation(MotionData.StartLocation);
+		RoundLocation(MotionData.TargetLocation);
+		for (int32 Index = 0; Index < MotionData.NumControlPoints; ++Index)
+		{
+			RoundLocation(MotionData.ControlPoints[Index]);
+		}
+
+		for (FRotator* Rotation : { &MotionData.StartRotation, &MotionData.TargetRotation })
+		{
+			Rotation->Yaw = FRotator::DecompressAxisFromShort(FRotator::CompressAxisToShort(Rotation->Yaw));
+			Rotation->Pitch = FRotator::DecompressAxisFromShort(FRotator::CompressAxisToShort(Rotation->Pitch));
+			Rotation->Roll = FRotator::DecompressAxisFromByte(FRotator::CompressAxisToByte(Rotation->Roll));
+		}
+	}
+
+	static uint32 SerializeCurve(FArchive& Ar, TSoftObjectPtr<UCurveFloat>& Curve)
+	{
+		const UCharacterMotionPresetRegistry* PresetRegistry = UCharacterMotionPresetRegistry::Get();
+
+		uint8 CurveIndex = Ar.IsSaving() && PresetRegistry ? PresetRegistry->FindCurveIndex(Curve) : UCharacterMotionPresetRegistry::NoCurve;
+		Ar.SerializeBits(&CurveIndex, CurveIndexBits);
+
+		if (Ar.IsLoading())
+		{
+			// Only the path, the manifest curves were preloaded with the map
+			Curve = PresetRegistry ? PresetRegistry->GetCurve(CurveIndex) : TSoftObjectPtr<UCurveFloat>();
+		}
+		return CurveIndexBits;
+	}
+
+	uint32 SerializeMotion(FArchive& Ar, UPackageMap* Map, FCharacterMotionData& MotionData, const FIntVector& Origin, bool& bOutSuccess)
+	{
+		uint32 NumBits = 3;
+
+		uint8 bHasPreset = MotionData.HasPreset();
+		Ar.SerializeBits(&bHasPreset, 1);
+
+		uint8 bDeterministic = MotionData.bDeterministic;
+		Ar.SerializeBits(&bDeterministic, 1);
+		MotionData.bDeterministic = bDeterministic != 0;
+
+		uint8 bSpline = MotionData.Trajectory == EMotionTrajectory::CatmullRom && MotionData.NumControlPoints > 0;
+		Ar.SerializeBits(&bSpline, 1);
+
+		if (bHasPreset)
+		{
+			Ar.SerializeBits(&MotionData.PresetIndex, PresetIndexBits);
+			NumBits += PresetIndexBits;
+		}
+
+		// Target is sent relative to the start, which usually needs far fewer bits than relative to the move
+		NumBits += SerializeLocation(Ar, MotionData.StartLocation, Origin);
+		const FIntVector StartOrigin(FMath::RoundToInt(MotionData.StartLocation.X), FMath::RoundToInt(MotionData.StartLocation.Y), FMath::RoundToInt(MotionData.StartLocation.Z));
+		NumBits += SerializeLocation(Ar, MotionData.TargetLocation, StartOrigin);
+
+		if (bSpline)
+		{
+			uint32 ControlPointCount = Ar.IsSaving() ? MotionData.NumControlPoints - 1 : 0;
+			Ar.SerializeBits(&ControlPointCount, ControlPointCountBits);
+			NumBits += ControlPointCountBits;
+
+			if (Ar.IsLoading())
+			{
+				MotionData.NumControlPoints = (uint8)(ControlPointCount + 1);
+				MotionData.Trajectory = EMotionTrajectory::CatmullRom;
+			}
+
+			// Consecutive points are close to each other, far closer than to the move
+			FIntVector PreviousPoint = StartOrigin;
+			for (int32 Index = 0; Index < MotionData.NumControlPoints; ++Index)
+			{
+				NumBits += SerializeLocation(Ar, MotionData.ControlPoints[Index], PreviousPoint);
+				PreviousPoint = FIntVector(FMath::RoundToInt(MotionData.ControlPoints[Index].X), FMath::RoundToInt(MotionData.ControlPoints[Index].Y), FMath::RoundToInt(MotionData.ControlPoints[Index].Z));
+			}
+		}
+		else if (Ar.IsLoading())
+		{
+			MotionData.NumControlPoints = 0;
+			MotionData.Trajectory = EMotionTrajectory::Linear;
+		}
+
+		NumBits += SerializeRotation(Ar, MotionData.StartRotation);
+		NumBits += SerializeRotation(Ar, MotionData.TargetRotation);
+
+		if (bHasPreset)
+		{
+			if (Ar.IsLoading())
+			{
+				bOutSuccess &= MotionData.ApplyPreset(MotionData.PresetIndex);
+			}
+		}
+		else
+		{
+			MotionData.PresetIndex = FCharacterMotionData::NoPreset;
+
+			uint8 bSweepDuringMotion = MotionData.bSweepDuringMotion;
+
+			NumBits += SerializeCurve(Ar, MotionData.MovementSpeedCurve);
+			NumBits += SerializeCurve(Ar, MotionData.MovementZMultiplierCurve);
+			Ar << MotionData.MaxZOffset;
+			Ar << MotionData.Duration;
+			Ar.SerializeBits(&bSweepDuringMotion, 1);
+			Ar << MotionData.MovementModeOnEnd;
+
+			MotionData.bSweepDuringMotion = bSweepDuringMotion != 0;
+
+			NumBits += 8 + 8 + 1 + 8;
+		}
+
+		bOutSuccess &= !Ar.IsError();
+		return NumBits;
+	}
+
+	void RegisterPackedMovementBits()
+	{
+		static bool bRegistered = false;
+		if (bRegistered)
+		{
+			return;
+		}
+
+		if (IConsoleVariable* CVarNetPackedMovementMaxBits = IConsoleManager::Get().FindConsoleVariable(TEXT("p.NetPackedMovementMaxBits")))
+		{
+			CVarNetPackedMovementMaxBits->Set(int32(CVarNetPackedMovementMaxBits->GetInt() + MaxPackedMotionBits));
+			bRegistered = true;
+		}
+	}
+}
@@ -0,0 +1,83 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FCharacterMotionData;
+class UPackageMap;
+
+/**
+ * Wire format of FCharacterMotionData.
+ * Locations are sent as whole unit deltas from an origin known to both sides, using only as many bits per component as the largest one needs.
+ * Rotations that only have a yaw are sent as a single short.
+ * Spline control points are sent as deltas from the point before them, in the same way.
+ * Curves are sent as their index in the curve manifest rather than through the package map, so receiving one never loads it.
+ * Every field has a fixed worst-case size, so the largest motion payload is known at compile time.
+ */
+namespace MotionNetSerialization
+{
+	// Bits used to send how many bits each delta component uses
+	constexpr uint32 DeltaBitCountBits = 5;
+
+	// Deltas are biased signed values. 22 bits cover any difference between two points inside WORLD_MAX.
+	constexpr uint32 MaxDeltaComponentBits = 22;
+
+	constexpr uint32 MaxDeltaBits = DeltaBitCountBits + 3 * MaxDeltaComponentBits;
+
+	// Yaw only flag, yaw and pitch shorts and a roll byte
+	constexpr uint32 MaxRotatorBits = 1 + 16 + 16 + 8;
+
+	constexpr uint32 PresetIndexBits = 8;
+
+	// Spline control points: their count minus one, then each one relative to the point before it
+	constexpr uint32 ControlPointCountBits = 2;
+	constexpr uint32 MaxControlPoints = 1 << ControlPointCountBits;
+	constexpr uint32 MaxSplineBits = ControlPointCountBits + MaxControlPoints * MaxDeltaBits;
+
+	// Index in the UCharacterMotionPresetRegistry curve manifest
+	constexpr uint32 CurveIndexBits = 8;
+
+	// Preset, deterministic and spline flags, locations, control points and rotations, then either a preset index or every motion setting
+	constexpr uint32 MaxPresetMotionBits = 3 + PresetIndexBits + 2 * MaxDeltaBits + MaxSplineBits + 2 * MaxRotatorBits;
+	constexpr uint32 MaxCustomMotionBits = 3 + 2 * MaxDeltaBits + MaxSplineBits + 2 * MaxRotatorBits + 2 * CurveIndexBits + 8 + 8 + 1 + 8;
+
+	constexpr uint32 MaxMotionBits = MaxPresetMotionBits > MaxCustomMotionBits ? MaxPresetMotionBits : MaxCustomMotionBits;
+
+	constexpr uint32 MotionSequenceBits = 8;
+
+	// Each motion payload is prefixed by its size in bits, so that the server can skip the ones it does not read
+	constexpr uint32 MotionPayloadSizeBits = 10;
+	static_assert(MaxMotionBits < (1 << MotionPayloadSizeBits), "MotionPayloadSizeBits cannot hold the largest motion payload");
+
+	// Motion time in milliseconds, durations are at most 255 seconds
+	constexpr uint32 MotionTimeMsBits = 18;
+
+	// A move carries the current motion and the ones queued after it until they are acked
+	constexpr uint32 MaxMotionsPerMove = 4;
+	constexpr uint32 MotionCountBits = 3;
+
+	// Largest motion payload of a move, including the motion count and the sequence of a triggered motion
+	constexpr uint32 MaxMoveMotionBits = MotionCountBits + MotionSequenceBits + MaxMotionsPerMove * (MotionSequenceBits + MotionPayloadSizeBits + MaxMotionBits);
+
+	/**
+	 * Returns the origin motion locations are sent relative to when they are serialized with a move ending at MoveLocation.
+	 * The receiver only knows the move location after FVector_NetQuantize100 quantization, so the sender applies the same rounding.
+	 */
+	FIntVector GetMoveOrigin(const FVector& MoveLocation, bool bIsSaving);
+
+	/* Rounds locations and rotations the way the wire format does, without going through it */
+	void QuantizeMotion(FCharacterMotionData& MotionData);
+
+	/* Serializes a motion relative to Origin. Returns the number of bits written or read. */
+	uint32 SerializeMotion(FArchive& Ar, UPackageMap* Map, FCharacterMotionData& MotionData, const FIntVector& Origin, bool& bOutSuccess);
+
+	uint32 SerializeLocation(FArchive& Ar, FVector& Location, const FIntVector& Origin);
+	uint32 SerializeRotation(FArchive& Ar, FRotator& Rotation);
+
+	/* The new, pending and old move of a packed movement RPC can all carry motions */
+	constexpr uint32 MaxPackedMotionBits = 3 * MaxMoveMotionBits;
+
+	/* Adds MaxPackedMotionBits to p.NetPackedMovementMaxBits, only the first time it is called */
+	void RegisterPackedMovementBits();
+}
@@ -0,0 +1,275 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MotionRecorder.h"
+#include "Engine/World.h"
+#include "GameFramework/WorldSettings.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/Paths.h"
+#include "Templates/Atomic.h"
+#include "VisualLogger/VisualLogger.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMotionRecorder, Log, All);
+
+namespace MotionRecorderCVars
+{
+	int32 EnableMotionRecorder = 0;
+	FAutoConsoleVariableRef CVarEnableMotionRecorder(
+		TEXT("p.MotionRecorder.Enable"),
+		EnableMotionRecorder,
+		TEXT("Whether motion samples are recorded, for p.MotionRecorder.Flush. The soak test turns it on.\n")
+		TEXT("0: Disable, 1: Enable"),
+		ECVF_Default);
+
+	int32 SamplesPerThread = 16384;
+	FAutoConsoleVariableRef CVarSamplesPerThread(
+		TEXT("p.MotionRecorder.SamplesPerThread"),
+		SamplesPerThread,
+		TEXT("Number of most recent samples kept for each recording thread, rounded up to a power of two. Read when a thread records its first sample."),
+		ECVF_ReadOnly);
+}
+
+namespace MotionRecorder
+{
+	constexpr uint32 FileMagic = 0x4345524D; // "MREC"
+	constexpr uint32 FileVersion = 1;
+
+	/* Ring of the samples of one thread. Only that thread writes it, Flush reads it from any thread. */
+	class FThreadRing
+	{
+	public:
+
+		explicit FThreadRing(int32 InCapacity)
+			: Capacity(FMath::RoundUpToPowerOfTwo(FMath::Max(InCapacity, 64)))
+		{
+			Samples.SetNum(Capacity);
+		}
+
+		void Push(const FMotionSample& Sample)
+		{
+			const uint64 Index = WriteIndex.Load(EMemoryOrder::Relaxed);
+			Samples[Index & (Capacity - 1)] = Sample;
+			WriteIndex.Store(Index + 1);
+		}
+
+		void CopyTo(TArray<FMotionSample>& OutSamples) const
+		{
+			const uint64 End = WriteIndex.Load();
+			const uint64 Begin = End > Capacity ? End - Capacity : 0;
+
+			const int32 FirstCopied = OutSamples.Num();
+			for (uint64 Index = Begin; Index < End; ++Index)
+			{
+				OutSamples.Add(Samples[Index & (Capacity - 1)]);
+			}
+
+			// The writer kept going during the copy, drop the slots it may have overwritten, including the one it may be writing
+			const uint64 ValidBegin = WriteIndex.Load() + 1;
+			if (ValidBegin > Begin + Capacity)
+			{
+				const int32 NumOverwritten = (int32)FMath::Min<uint64>(ValidBegin - Capacity - Begin, End - Begin);
+				OutSamples.RemoveAt(FirstCopied, NumOverwritten, false);
+			}
+		}
+
+	private:
+
+		const uint32 Capacity;
+		TArray<FMotionSample> Samples;
+		TAtomic<uint64> WriteIndex { 0 };
+	};
+
+	// Threads look their ring up once per generation. Flush starts a new one and lets go of the rings, each of them is freed
+	// when its thread records again or exits, never while it is writing it.
+	static FCriticalSection RingsCriticalSection;
+	static TArray<TSharedPtr<FThreadRing, ESPMode::ThreadSafe>> Rings;
+	static TAtomic<uint32> RingsGeneration { 0 };
+
+	static void ReleaseRings()
+	{
+		FScopeLock Lock(&RingsCriticalSection);
+		Rings.Empty();
+		++RingsGeneration;
+	}
+
+	static FThreadRing& GetThreadRing()
+	{
+		static thread_local TSharedPtr<FThreadRing, ESPMode::ThreadSafe> ThreadRing;
+		static thread_local uint32 ThreadRingGeneration = 0;
+
+		const uint32 Generation = RingsGeneration.Load(EMemoryOrder::Relaxed);
+		if (!ThreadRing.IsValid() || ThreadRingGeneration != Generation)
+		{
+			static const FDelegateHandle ExitHandle = FCoreDelegates::OnExit.AddStatic(&ReleaseRings);
+
+			FScopeLock Lock(&RingsCriticalSection);
+			ThreadRing = Rings.Add_GetRef(MakeShared<FThreadRing, ESPMode::ThreadSafe>(MotionRecorderCVars::SamplesPerThread));
+			ThreadRingGeneration = RingsGeneration.Load();
+		}
+		return *ThreadRing;
+	}
+
+	static FAutoConsoleCommand FlushCommand(
+		TEXT("p.MotionRecorder.Flush"),
+		TEXT("Writes the recorded motion samples to the given path, or to Saved/MotionRecordings/ if there is none."),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			const FString Path = Args.Num() > 0 ? Args[0] : FPaths::ProjectSavedDir() / TEXT("MotionRecordings") / FString::Printf(TEXT("MotionRecording_%s.bin"), *FDateTime::Now().ToString());
+			const int32 NumSamples = FMotionRecorder::Flush(Path);
+			if (NumSamples == INDEX_NONE)
+			{
+				UE_LOG(LogMotionRecorder, Error, TEXT("Could not write %s"), *Path);
+				return;
+			}
+
+			UE_LOG(LogMotionRecorder, Display, TEXT("%d motion samples written to %s"), NumSamples, *Path);
+		}));
+
+	static FAutoConsoleCommandWithWorldAndArgs LoadCommand(
+		TEXT("p.MotionRecorder.Load"),
+		TEXT("Reads a motion recording and adds its samples to the Visual Logger, at their recorded times."),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+		{
+			TArray<FMotionSample> Samples;
+			if (Args.Num() == 0 || !FMotionRecorder::Load(Args[0], Samples))
+			{
+				UE_LOG(LogMotionRecorder, Error, TEXT("Usage: p.MotionRecorder.Load Path, with a file written by p.MotionRecorder.Flush"));
+				return;
+			}
+
+#if ENABLE_VISUAL_LOG
+			const UObject* LogOwner = World ? World->GetWorldSettings() : nullptr;
+			if (LogOwner == nullptr || !FVisualLogger::IsRecording())
+			{
+				UE_LOG(LogMotionRecorder, Warning, TEXT("Start recording in the Visual Logger before loading a motion recording"));
+				return;
+			}
+
+			for (const FMotionSample& Sample : Samples)
+			{
+				FVisualLogEntry* Entry = FVisualLogger::Get().GetEntryToWrite(LogOwner, (float)Sample.WorldTime);
+				if (Entry == nullptr)
+				{
+					continue;
+				}
+
+				// Server in red, corrections in yellow, predicting clients in blue and simulated proxies in cyan
+				const FColor Color = (Sample.Flags & FMotionSample::Correction) ? FColor::Yellow
+					: (Sample.Flags & FMotionSample::Authority) ? FColor::Red
+					: (Sample.Flags & FMotionSample::SimulatedProxy) ? FColor::Cyan
+					: FColor::Blue;
+
+				const FString Description = FString::Printf(TEXT("%u #%u %.3fs%s"), Sample.CharacterId, Sample.Sequence, Sample.MotionTime, (Sample.Flags & FMotionSample::Replaying) ? TEXT(" replay") : TEXT(""));
+				Entry->AddElement(Sample.Location, LogMotionRecorder.GetCategoryName(), ELogVerbosity::Log, Color, Description);
+			}
+
+			UE_LOG(LogMotionRecorder, Display, TEXT("%d motion samples added to the Visual Logger"), Samples.Num());
+#else
+			UE_LOG(LogMotionRecorder, Display, TEXT("%d motion samples read, the Visual Logger is not available in this build"), Samples.Num());
+#endif
+		}));
+}
+
+FArchive& operator<<(FArchive& Ar, FMotionSample& Sample)
+{
+	// Rotations as the usual compressed shorts
+	uint16 Pitch = FRotator::CompressAxisToShort(Sample.Rotation.Pitch);
+	uint16 Yaw = FRotator::CompressAxisToShort(Sample.Rotation.Yaw);
+	uint16 Roll = FRotator::CompressAxisToShort(Sample.Rotation.Roll);
+
+	Ar << Sample.WorldTime << Sample.MotionTime << Sample.Location << Pitch << Yaw << Roll << Sample.CharacterId << Sample.Sequence << Sample.Flags;
+
+	if (Ar.IsLoading())
+	{
+		Sample.Rotation = FRotator(FRotator::DecompressAxisFromShort(Pitch), FRotator::DecompressAxisFromShort(Yaw), FRotator::DecompressAxisFromShort(Roll));
+	}
+
+	return Ar;
+}
+
+bool FMotionRecorder::IsEnabled()
+{
+	return MotionRecorderCVars::EnableMotionRecorder != 0;
+}
+
+void FMotionRecorder::SetEnabled(bool bEnabled)
+{
+	if (IConsoleVariable* CVarEnable = IConsoleManager::Get().FindConsoleVariable(TEXT("p.MotionRecorder.Enable")))
+	{
+		CVarEnable->Set(bEnabled ? 1 : 0, ECVF_SetByCode);
+	}
+}
+
+void FMotionRecorder::Record(const FMotionSample& Sample)
+{
+	if (IsEnabled())
+	{
+		MotionRecorder::GetThreadRing().Push(Sample);
+	}
+}
+
+int32 FMotionRecorder::Flush(const FString& Path)
+{
+	TArray<FMotionSample> Samples;
+	{
+		FScopeLock Lock(&MotionRecorder::RingsCriticalSection);
+		for (const TSharedPtr<MotionRecorder::FThreadRing, ESPMode::ThreadSafe>& Ring : MotionRecorder::Rings)
+		{
+			Ring->CopyTo(Samples);
+		}
+	}
+
+	TUniquePtr<FArchive> Writer(IFileManager::Get().CreateFileWriter(*Path));
+	if (!Writer)
+	{
+		return INDEX_NONE;
+	}
+
+	uint32 Magic = MotionRecorder::FileMagic;
+	uint32 Version = MotionRecorder::FileVersion;
+	int32 NumSamples = Samples.Num();
+	*Writer << Magic << Version << NumSamples;
+
+	for (FMotionSample& Sample : Samples)
+	{
+		*Writer << Sample;
+	}
+
+	if (!Writer->Close())
+	{
+		return INDEX_NONE;
+	}
+
+	// Written samples are not kept, the rings of threads that stopped recording are freed right away
+	MotionRecorder::ReleaseRings();
+	return NumSamples;
+}
+
+bool FMotionRecorder::Load(const FString& Path, TArray<FMotionSample>& OutSamples)
+{
+	TUniquePtr<FArchive> Reader(IFileManager::Get().CreateFileReader(*Path));
+	if (!Reader)
+	{
+		return false;
+	}
+
+	uint32 Magic = 0;
+	uint32 Version = 0;
+	int32 NumSamples = 0;
+	*Reader << Magic << Version << NumSamples;
+
+	// Every sample takes at least a byte, a count past the end of the file is a corrupt header
+	if (Magic != MotionRecorder::FileMagic || Version != MotionRecorder::FileVersion || NumSamples < 0 || NumSamples > Reader->TotalSize())
+	{
+		return false;
+	}
+
+	OutSamples.SetNum(NumSamples);
+	for (FMotionSample& Sample : OutSamples)
+	{
+		*Reader << Sample;
+	}
+
+	return !Reader->IsError();
+}
@@ -0,0 +1,57 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/* Pose of a character at one step of a motion, as predicted by its client, simulated by the server or set by a correction */
+struct FMotionSample
+{
+	enum EFlags : uint8
+	{
+		Authority = 1 << 0,
+		Replaying = 1 << 1,
+		Correction = 1 << 2,
+		SimulatedProxy = 1 << 3,
+		Ended = 1 << 4
+	};
+
+	// Server world time of the sample, so that client and server recordings line up
+	double WorldTime = 0.0;
+	float MotionTime = 0.0f;
+	FVector Location = FVector::ZeroVector;
+	FRotator Rotation = FRotator::ZeroRotator;
+
+	// Player id of the character, the same in every process, or its object id when it has no player state
+	uint32 CharacterId = 0;
+
+	uint8 Sequence = 0;
+	uint8 Flags = 0;
+
+	friend FArchive& operator<<(FArchive& Ar, FMotionSample& Sample);
+};
+
+/**
+ * Recorder of motion samples, off unless p.MotionRecorder.Enable is set, for instance with -dpcvars=p.MotionRecorder.Enable=1.
+ * Each thread records into its own ring buffer without locks, only the most recent samples are kept until they are flushed.
+ *
+ *   p.MotionRecorder.Flush [Path]	writes the samples of every thread to a binary file, under Saved/MotionRecordings/ by default
+ *   p.MotionRecorder.Load Path	reads a recording back and adds its samples to the Visual Logger, which has to be recording
+ */
+class MYPROJECT_API FMotionRecorder
+{
+public:
+
+	static bool IsEnabled();
+
+	/* Sets p.MotionRecorder.Enable, for tests that want a recording of their run */
+	static void SetEnabled(bool bEnabled);
+
+	static void Record(const FMotionSample& Sample);
+
+	/* Writes the recorded samples, grouped per thread and oldest first, and frees them. Returns the number of samples written, INDEX_NONE if the file could not be written. */
+	static int32 Flush(const FString& Path);
+
+	/* Reads the samples of a recording written by Flush */
+	static bool Load(const FString& Path, TArray<FMotionSample>& OutSamples);
+};
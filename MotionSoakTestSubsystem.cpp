@@ -0,0 +1,373 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MotionSoakTestSubsystem.h"
+#include "MyCharacterMovementComponent.h"
+#include "MyProjectCharacter.h"
+#include "MotionRecorder.h"
+#include "Engine/GameInstance.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/PlatformProcess.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+bool UMotionSoakTestSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	return FParse::Param(FCommandLine::Get(), TEXT("MotionSoak"));
+}
+
+void UMotionSoakTestSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	const TCHAR* CommandLine = FCommandLine::Get();
+
+	FParse::Value(CommandLine, TEXT("MotionSoakSeed="), Seed);
+	RandomStream.Initialize(Seed);
+
+	// The packet simulation rolls its losses with FMath::FRand
+	FMath::RandInit(Seed);
+	FParse::Value(CommandLine, TEXT("MotionSoakMaxPktLag="), MaxPktLag);
+	FParse::Value(CommandLine, TEXT("MotionSoakMaxPktLoss="), MaxPktLoss);
+
+	FParse::Value(CommandLine, TEXT("MotionSoakDuration="), Duration);
+	FParse::Value(CommandLine, TEXT("MotionSoakClients="), ExpectedClients);
+	FParse::Value(CommandLine, TEXT("MotionSoakMaxCorrectionsPerMotion="), Thresholds.MaxCorrectionsPerMotion);
+	FParse::Value(CommandLine, TEXT("MotionSoakMaxResendsPerMotion="), Thresholds.MaxResendsPerMotion);
+	FParse::Value(CommandLine, TEXT("MotionSoakMaxPositionError="), Thresholds.MaxPositionError);
+	FParse::Value(CommandLine, TEXT("MotionSoakMaxBytesPerSecond="), Thresholds.MaxBytesPerSecond);
+
+	// Failed client runs leave a recording next to their report
+	FMotionRecorder::SetEnabled(true);
+
+	bLaunchClients = FParse::Param(CommandLine, TEXT("MotionSoakLaunchClients"));
+	ClientExecutable = FPlatformProcess::ExecutablePath();
+	FParse::Value(CommandLine, TEXT("MotionSoakClientExe="), ClientExecutable);
+
+	TickHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &UMotionSoakTestSubsystem::Tick));
+
+	UE_LOG(LogTemp, Display, TEXT("UMotionSoakTestSubsystem - seed %d, %.0f seconds, %d clients"), Seed, Duration, ExpectedClients);
+}
+
+void UMotionSoakTestSubsystem::Deinitialize()
+{
+	FTicker::GetCoreTicker().RemoveTicker(TickHandle);
+
+	for (FProcHandle& ClientProcess : ClientProcesses)
+	{
+		FPlatformProcess::CloseProc(ClientProcess);
+	}
+	ClientProcesses.Reset();
+
+	Super::Deinitialize();
+}
+
+bool UMotionSoakTestSubsystem::Tick(float DeltaTime)
+{
+	const UWorld* World = GetGameInstance()->GetWorld();
+	if (bFinished || World == nullptr)
+	{
+		return true;
+	}
+
+	if (!bAppliedPacketSimulation && World->GetNetDriver())
+	{
+		ApplyPacketSimulation(*World->GetNetDriver());
+	}
+
+	if (World->GetNetMode() == NM_Client)
+	{
+		TickClient(DeltaTime);
+	}
+	else if (World->GetNetMode() != NM_Standalone)
+	{
+		TickServer();
+	}
+
+	return true;
+}
+
+void UMotionSoakTestSubsystem::TickClient(float DeltaTime)
+{
+	AMyProjectCharacter* Character = GetLocalCharacter();
+	UMyCharacterMovementComponent* MoveComp = Character ? Cast<UMyCharacterMovementComponent>(Character->GetCharacterMovement()) : nullptr;
+	if (MoveComp == nullptr)
+	{
+		// Not spawned yet, the test time starts with the character
+		return;
+	}
+
+	ElapsedTime += DeltaTime;
+
+	const bool bIdle = !MoveComp->GetCurrentMotionData().HasValidData();
+	if (ElapsedTime >= Duration)
+	{
+		// Let the last motion end before measuring
+		if (bIdle)
+		{
+			FinishClient();
+		}
+		return;
+	}
+
+	const UNetDriver* NetDriver = GetGameInstance()->GetWorld()->GetNetDriver();
+	if (ElapsedTime >= NextBandwidthSampleTime && NetDriver && NetDriver->ServerConnection)
+	{
+		TotalBytesPerSecond += NetDriver->ServerConnection->InBytesPerSecond + NetDriver->ServerConnection->OutBytesPerSecond;
+		++NumBandwidthSamples;
+		NextBandwidthSampleTime = ElapsedTime + 1.0f;
+	}
+
+	// Bursts of one to three motions back to back, separated by a random pause. The first one is triggered, the others
+	// are queued behind it while it runs, so that they are sent ahead of it and acked while it plays.
+	if (BurstMotionsLeft == 0 && bIdle && ElapsedTime >= NextBurstTime)
+	{
+		const int32 BurstSize = RandomStream.RandRange(1, 3);
+		BurstMotionsLeft = BurstSize - 1;
+		BurstTriggerTime = ElapsedTime;
+
+		// The motion only starts with the next move
+		Character->StartPredictiveMotion();
+		NextBurstTime = ElapsedTime + BurstSize * Character->MakePredictiveMotion().Duration + RandomStream.FRandRange(0.5f, 3.0f);
+		return;
+	}
+
+	if (BurstMotionsLeft > 0)
+	{
+		if (bIdle)
+		{
+			if (ElapsedTime - BurstTriggerTime > 1.0f)
+			{
+				// The triggered motion never started, neither do the ones chained to it
+				BurstMotionsLeft = 0;
+			}
+			return;
+		}
+
+		const FCharacterMotionData& TriggeredMotion = MoveComp->GetCurrentMotionData();
+		BurstEndLocation = TriggeredMotion.TargetLocation;
+		BurstEndRotation = TriggeredMotion.TargetRotation;
+
+		for (; BurstMotionsLeft > 0; --BurstMotionsLeft)
+		{
+			StartChainedMotion(*Character);
+		}
+	}
+}
+
+void UMotionSoakTestSubsystem::StartChainedMotion(AMyProjectCharacter& Character)
+{
+	// The same dash the character triggers, turned and moved to start where the previous motion of the burst ends
+	FCharacterMotionData Motion = Character.MakePredictiveMotion();
+	const FVector DashDelta = Motion.TargetLocation - Motion.StartLocation;
+	const FRotator DashTurn = (Motion.TargetRotation - Motion.StartRotation).GetNormalized();
+	const FRotator StartTurn = (BurstEndRotation - Motion.StartRotation).GetNormalized();
+
+	Motion.StartLocation = BurstEndLocation;
+	Motion.TargetLocation = BurstEndLocation + StartTurn.RotateVector(DashDelta);
+	Motion.StartRotation = BurstEndRotation;
+	Motion.TargetRotation = BurstEndRotation + DashTurn;
+
+	CastChecked<UMyCharacterMovementComponent>(Character.GetCharacterMovement())->StartMotion(Motion);
+
+	BurstEndLocation = Motion.TargetLocation;
+	BurstEndRotation = Motion.TargetRotation;
+}
+
+void UMotionSoakTestSubsystem::TickServer()
+{
+	SampleMotionEndErrors();
+
+	if (bLaunchClients)
+	{
+		if (ClientProcesses.Num() == 0)
+		{
+			LaunchClients();
+		}
+
+		for (FProcHandle& ClientProcess : ClientProcesses)
+		{
+			if (FPlatformProcess::IsProcRunning(ClientProcess))
+			{
+				return;
+			}
+		}
+
+		for (FProcHandle& ClientProcess : ClientProcesses)
+		{
+			int32 ReturnCode = 1;
+			bClientFailed |= !FPlatformProcess::GetProcReturnCode(ClientProcess, &ReturnCode) || ReturnCode != 0;
+		}
+
+		UE_LOG(LogTemp, Display, TEXT("UMotionSoakTestSubsystem - every client exited, %s"), bClientFailed ? TEXT("some FAILED") : TEXT("all passed"));
+		FinishServer(!bClientFailed);
+		return;
+	}
+
+	const int32 NumConnectedClients = GetGameInstance()->GetWorld()->GetNumPlayerControllers();
+	MaxConnectedClients = FMath::Max(MaxConnectedClients, NumConnectedClients);
+
+	if (MaxConnectedClients >= ExpectedClients && NumConnectedClients == 0)
+	{
+		UE_LOG(LogTemp, Display, TEXT("UMotionSoakTestSubsystem - every client left, exiting"));
+		FinishServer(true);
+	}
+}
+
+void UMotionSoakTestSubsystem::SampleMotionEndErrors()
+{
+	for (FConstPlayerControllerIterator It = GetGameInstance()->GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		const APawn* Pawn = PlayerController ? PlayerController->GetPawn() : nullptr;
+		if (const UMyCharacterMovementComponent* MoveComp = Pawn ? Cast<UMyCharacterMovementComponent>(Pawn->GetMovementComponent()) : nullptr)
+		{
+			const FMotionNetStats& Stats = MoveComp->GetMotionNetStats();
+			FMotionEndErrors& Errors = MotionEndErrors.FindOrAdd(MoveComp);
+			Errors.MotionEnds = Stats.MotionEnds;
+			Errors.TotalError = Stats.TotalMotionEndError;
+			Errors.MaxError = Stats.MaxMotionEndError;
+		}
+	}
+}
+
+void UMotionSoakTestSubsystem::FinishServer(bool bClientsPassed)
+{
+	FMotionEndErrors Total;
+	for (const TPair<TWeakObjectPtr<const UMyCharacterMovementComponent>, FMotionEndErrors>& Client : MotionEndErrors)
+	{
+		Total.MotionEnds += Client.Value.MotionEnds;
+		Total.TotalError += Client.Value.TotalError;
+		Total.MaxError = FMath::Max(Total.MaxError, Client.Value.MaxError);
+	}
+
+	const float MeanPositionError = Total.MotionEnds > 0 ? (float)(Total.TotalError / Total.MotionEnds) : 0.0f;
+	const bool bPassed = bClientsPassed && Total.MaxError <= Thresholds.MaxPositionError;
+
+	const FString Report = FString::Printf(TEXT("{\n")
+		TEXT("\t\"passed\": %s,\n")
+		TEXT("\t\"clients_passed\": %s,\n")
+		TEXT("\t\"motion_ends\": %d,\n")
+		TEXT("\t\"mean_position_error\": %.2f,\n")
+		TEXT("\t\"max_position_error\": %.2f\n")
+		TEXT("}\n"),
+		bPassed ? TEXT("true") : TEXT("false"), bClientsPassed ? TEXT("true") : TEXT("false"), Total.MotionEnds, MeanPositionError, Total.MaxError);
+
+	const FString ReportPath = FPaths::ProjectSavedDir() / TEXT("MotionSoak") / TEXT("Server.json");
+	FFileHelper::SaveStringToFile(Report, *ReportPath);
+
+	UE_LOG(LogTemp, Display, TEXT("UMotionSoakTestSubsystem - %s, report written to %s\n%s"), bPassed ? TEXT("passed") : TEXT("FAILED"), *ReportPath, *Report);
+
+	Exit(bPassed);
+}
+
+void UMotionSoakTestSubsystem::LaunchClients()
+{
+	// Editor executables need the project, packaged games know theirs
+	const FString ProjectArgument = FPaths::IsProjectFilePathSet() ? FString::Printf(TEXT("\"%s\" "), *FPaths::ConvertRelativePathToFull(FPaths::GetProjectFilePath())) : FString();
+	const int32 Port = GetGameInstance()->GetWorld()->URL.Port;
+
+	for (int32 ClientIndex = 0; ClientIndex < ExpectedClients; ++ClientIndex)
+	{
+		const FString ClientParams = FString::Printf(TEXT("%s127.0.0.1:%d -game -nullrhi -nosound -unattended -log -MotionSoak -MotionSoakSeed=%d -MotionSoakDuration=%f ")
+			TEXT("-MotionSoakMaxPktLag=%d -MotionSoakMaxPktLoss=%d -MotionSoakMaxCorrectionsPerMotion=%f -MotionSoakMaxResendsPerMotion=%f -MotionSoakMaxPositionError=%f -MotionSoakMaxBytesPerSecond=%f"),
+			*ProjectArgument, Port, Seed + ClientIndex + 1, Duration, MaxPktLag, MaxPktLoss,
+			Thresholds.MaxCorrectionsPerMotion, Thresholds.MaxResendsPerMotion, Thresholds.MaxPositionError, Thresholds.MaxBytesPerSecond);
+
+		FProcHandle ClientProcess = FPlatformProcess::CreateProc(*ClientExecutable, *ClientParams, false, true, true, nullptr, 0, nullptr, nullptr);
+		if (!ClientProcess.IsValid())
+		{
+			UE_LOG(LogTemp, Error, TEXT("UMotionSoakTestSubsystem - could not start client %d with %s %s"), ClientIndex, *ClientExecutable, *ClientParams);
+			bClientFailed = true;
+			continue;
+		}
+
+		ClientProcesses.Add(ClientProcess);
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("UMotionSoakTestSubsystem - started %d of %d clients on port %d"), ClientProcesses.Num(), ExpectedClients, Port);
+	if (ClientProcesses.Num() == 0)
+	{
+		Exit(false);
+	}
+}
+
+void UMotionSoakTestSubsystem::ApplyPacketSimulation(UNetDriver& NetDriver)
+{
+	bAppliedPacketSimulation = true;
+	if (MaxPktLag <= 0 && MaxPktLoss <= 0)
+	{
+		// Left to the usual packet simulation options
+		return;
+	}
+
+#if DO_ENABLE_NET_TEST
+	FPacketSimulationSettings Settings = NetDriver.PacketSimulationSettings;
+	Settings.PktLag = RandomStream.RandRange(MaxPktLag / 2, MaxPktLag);
+	Settings.PktLagVariance = Settings.PktLag / 4;
+	Settings.PktLoss = RandomStream.RandRange(0, MaxPktLoss);
+	NetDriver.SetPacketSimulationSettings(Settings);
+
+	UE_LOG(LogTemp, Display, TEXT("UMotionSoakTestSubsystem - %d ms lag, %d ms variance, %d%% packet loss"), Settings.PktLag, Settings.PktLagVariance, Settings.PktLoss);
+#else
+	UE_LOG(LogTemp, Warning, TEXT("UMotionSoakTestSubsystem - packet simulation is not available in this build, lag and loss are not applied"));
+#endif
+}
+
+AMyProjectCharacter* UMotionSoakTestSubsystem::GetLocalCharacter() const
+{
+	const APlayerController* PlayerController = GetGameInstance()->GetFirstLocalPlayerController();
+	return PlayerController ? Cast<AMyProjectCharacter>(PlayerController->GetPawn()) : nullptr;
+}
+
+void UMotionSoakTestSubsystem::FinishClient()
+{
+	const UMyCharacterMovementComponent* MoveComp = CastChecked<UMyCharacterMovementComponent>(GetLocalCharacter()->GetCharacterMovement());
+	const FMotionNetStats& Stats = MoveComp->GetMotionNetStats();
+
+	const float NumMotions = (float)FMath::Max(1, Stats.MotionsStarted);
+	const float CorrectionsPerMotion = Stats.CorrectionsDuringMotion / NumMotions;
+	const float ResendsPerMotion = FMath::Max(0, Stats.MotionsSent - Stats.MotionsStarted) / NumMotions;
+	const float ImportantResendsPerMotion = Stats.MotionsResentAsImportant / NumMotions;
+	const float MeanCorrectionError = Stats.Corrections > 0 ? (float)(Stats.TotalCorrectionError / Stats.Corrections) : 0.0f;
+	const float BytesPerSecond = NumBandwidthSamples > 0 ? (float)(TotalBytesPerSecond / NumBandwidthSamples) : 0.0f;
+
+	const bool bPassed = Stats.MotionsStarted > 0
+		&& CorrectionsPerMotion <= Thresholds.MaxCorrectionsPerMotion
+		&& ResendsPerMotion <= Thresholds.MaxResendsPerMotion
+		&& BytesPerSecond <= Thresholds.MaxBytesPerSecond;
+
+	const FString Report = FString::Printf(TEXT("{\n")
+		TEXT("\t\"passed\": %s,\n")
+		TEXT("\t\"motions\": %d,\n")
+		TEXT("\t\"corrections\": %d,\n")
+		TEXT("\t\"corrections_per_motion\": %.3f,\n")
+		TEXT("\t\"resends_per_motion\": %.3f,\n")
+		TEXT("\t\"important_resends_per_motion\": %.3f,\n")
+		TEXT("\t\"mean_correction_error\": %.2f,\n")
+		TEXT("\t\"max_correction_error\": %.2f,\n")
+		TEXT("\t\"bytes_per_second\": %.1f\n")
+		TEXT("}\n"),
+		bPassed ? TEXT("true") : TEXT("false"), Stats.MotionsStarted, Stats.Corrections, CorrectionsPerMotion, ResendsPerMotion,
+		ImportantResendsPerMotion, MeanCorrectionError, Stats.MaxCorrectionError, BytesPerSecond);
+
+	const FString ReportPath = FPaths::ProjectSavedDir() / TEXT("MotionSoak") / FString::Printf(TEXT("Client_%u.json"), FPlatformProcess::GetCurrentProcessId());
+	FFileHelper::SaveStringToFile(Report, *ReportPath);
+
+	UE_LOG(LogTemp, Display, TEXT("UMotionSoakTestSubsystem - %s, report written to %s\n%s"), bPassed ? TEXT("passed") : TEXT("FAILED"), *ReportPath, *Report);
+
+	if (!bPassed)
+	{
+		FMotionRecorder::Flush(FPaths::ChangeExtension(ReportPath, TEXT("bin")));
+	}
+
+	Exit(bPassed);
+}
+
+void UMotionSoakTestSubsystem::Exit(bool bSuccess)
+{
+	bFinished = true;
+	FPlatformMisc::RequestExitWithStatus(false, bSuccess ? 0 : 1);
+}
@@ -0,0 +1,123 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "HAL/PlatformProcess.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "MotionSoakTestSubsystem.generated.h"
+
+class AMyProjectCharacter;
+class UMyCharacterMovementComponent;
+class UNetDriver;
+
+/**
+ * Headless soak test of motion prediction, only created when the command line has -MotionSoak.
+ * With -MotionSoakLaunchClients, the server starts the -MotionSoakClients= clients itself on loopback, passing them its MotionSoak options.
+ * Each client gets the server seed plus its index, the seed picks the lag and packet loss of each process up to the given maximums
+ * and seeds the random rolls of the packet simulation, so that a run can be reproduced:
+ *
+ *   UE4Editor MyProject -server -log -MotionSoak -MotionSoakLaunchClients -MotionSoakClients=4 -MotionSoakSeed=1 -MotionSoakMaxPktLag=150 -MotionSoakMaxPktLoss=3
+ *
+ * Clients run with the server executable unless -MotionSoakClientExe= names another one, a dedicated server build can't run them.
+ * Clients can also be started by hand:
+ *
+ *   UE4Editor MyProject 127.0.0.1 -game -nullrhi -log -MotionSoak -MotionSoakSeed=2 -MotionSoakMaxPktLag=150 -MotionSoakMaxPktLoss=3
+ *
+ * Each client starts scripted bursts of chained motions for -MotionSoakDuration= seconds, writes its corrections and resends per motion,
+ * correction error and bandwidth to Saved/MotionSoak/, and exits with 0 if they are within the -MotionSoakMax*= thresholds, 1 otherwise.
+ * A failed client also writes its FMotionRecorder samples there, the recorder is on for the whole run.
+ * The server measures the position error between each client and itself at the end of every motion, and checks it against
+ * -MotionSoakMaxPositionError=. It exits once the expected clients have connected and left again, with 1 if the error is above it
+ * or a client it launched failed.
+ */
+UCLASS()
+class UMotionSoakTestSubsystem : public UGameInstanceSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+private:
+
+	struct FThresholds
+	{
+		float MaxCorrectionsPerMotion = 1.0f;
+		float MaxResendsPerMotion = 10.0f;
+		float MaxPositionError = 100.0f;
+		float MaxBytesPerSecond = 8192.0f;
+	};
+
+	bool Tick(float DeltaTime);
+	void TickClient(float DeltaTime);
+	void TickServer();
+	void LaunchClients();
+	void ApplyPacketSimulation(UNetDriver& NetDriver);
+
+	AMyProjectCharacter* GetLocalCharacter() const;
+
+	/* Starts the next motion of a burst, queued to start where the previous one ends */
+	void StartChainedMotion(AMyProjectCharacter& Character);
+
+	void FinishClient();
+
+	/* Keeps the motion end errors of the connected clients, they are gone with their character when the client leaves */
+	void SampleMotionEndErrors();
+
+	/* Writes the motion end errors of every client to Saved/MotionSoak/ and exits */
+	void FinishServer(bool bClientsPassed);
+
+	void Exit(bool bSuccess);
+
+	FDelegateHandle TickHandle;
+
+	int32 Seed = 1;
+	FRandomStream RandomStream;
+	FThresholds Thresholds;
+	float Duration = 60.0f;
+	int32 ExpectedClients = 1;
+
+	// Packet simulation picked from the seed, in milliseconds and percent
+	int32 MaxPktLag = 0;
+	int32 MaxPktLoss = 0;
+	bool bAppliedPacketSimulation = false;
+
+	float ElapsedTime = 0.0f;
+	float NextBurstTime = 0.0f;
+	int32 BurstMotionsLeft = 0;
+
+	// The first motion of a burst is triggered, the others are queued behind it as soon as it runs. Where the last one queued ends.
+	float BurstTriggerTime = 0.0f;
+	FVector BurstEndLocation = FVector::ZeroVector;
+	FRotator BurstEndRotation = FRotator::ZeroRotator;
+
+	// Outgoing and incoming bytes per second of the server connection, sampled once per second
+	float NextBandwidthSampleTime = 0.0f;
+	double TotalBytesPerSecond = 0.0;
+	int32 NumBandwidthSamples = 0;
+
+	int32 MaxConnectedClients = 0;
+
+	struct FMotionEndErrors
+	{
+		int32 MotionEnds = 0;
+		double TotalError = 0.0;
+		float MaxError = 0.0f;
+	};
+
+	// Server side, the last motion end errors seen for each client character
+	TMap<TWeakObjectPtr<const UMyCharacterMovementComponent>, FMotionEndErrors> MotionEndErrors;
+
+	// Clients started by the server with -MotionSoakLaunchClients
+	bool bLaunchClients = false;
+	FString ClientExecutable;
+	TArray<FProcHandle> ClientProcesses;
+	bool bClientFailed = false;
+
+	bool bFinished = false;
+};
@@ -0,0 +1,194 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MotionStats.h"
+
+#if MOTION_STATS
+
+#include "HAL/IConsoleManager.h"
+#include "ProfilingDebugging/CountersTrace.h"
+
+DEFINE_STAT(STAT_PhysCustomMotion);
+DEFINE_STAT(STAT_MotionNetSerialize);
+DEFINE_STAT(STAT_MoveSerialize);
+DEFINE_STAT(STAT_ServerMovePerformMovement);
+DEFINE_STAT(STAT_BatchedMotionEvaluate);
+
+DEFINE_STAT(STAT_MotionsStarted);
+DEFINE_STAT(STAT_MotionsAcked);
+DEFINE_STAT(STAT_MotionsResumed);
+DEFINE_STAT(STAT_MotionsDropped);
+DEFINE_STAT(STAT_MotionStartsAccepted);
+DEFINE_STAT(STAT_MotionStartsThrottled);
+DEFINE_STAT(STAT_SavedMovesReused);
+DEFINE_STAT(STAT_SavedMovesAllocated);
+DEFINE_STAT(STAT_SavedMovesDropped);
+DEFINE_STAT(STAT_FreeSavedMoves);
+DEFINE_STAT(STAT_SavedMovesHighWaterMark);
+
+UE_TRACE_CHANNEL_DEFINE(MotionChannel);
+
+UE_TRACE_EVENT_BEGIN(CharacterMotion, Ack)
+	UE_TRACE_EVENT_FIELD(uint64, Cycle)
+	UE_TRACE_EVENT_FIELD(uint32, LatencyMs)
+UE_TRACE_EVENT_END()
+
+UE_TRACE_EVENT_BEGIN(CharacterMotion, MoveBits)
+	UE_TRACE_EVENT_FIELD(uint64, Cycle)
+	UE_TRACE_EVENT_FIELD(uint32, Bits)
+UE_TRACE_EVENT_END()
+
+TRACE_DECLARE_INT_COUNTER(MotionsStarted, TEXT("CharacterMotion/Started"));
+TRACE_DECLARE_INT_COUNTER(MotionsAcked, TEXT("CharacterMotion/Acked"));
+TRACE_DECLARE_INT_COUNTER(MotionsResumed, TEXT("CharacterMotion/ResumedAfterCorrection"));
+TRACE_DECLARE_INT_COUNTER(MotionsDropped, TEXT("CharacterMotion/Dropped"));
+TRACE_DECLARE_INT_COUNTER(MotionStartsAccepted, TEXT("CharacterMotion/StartsAccepted"));
+TRACE_DECLARE_INT_COUNTER(MotionStartsThrottled, TEXT("CharacterMotion/StartsThrottled"));
+TRACE_DECLARE_INT_COUNTER(SavedMovesReused, TEXT("CharacterMotion/SavedMovesReused"));
+TRACE_DECLARE_INT_COUNTER(SavedMovesAllocated, TEXT("CharacterMotion/SavedMovesAllocated"));
+TRACE_DECLARE_INT_COUNTER(SavedMovesDropped, TEXT("CharacterMotion/SavedMovesDropped"));
+TRACE_DECLARE_INT_COUNTER(FreeSavedMoves, TEXT("CharacterMotion/FreeSavedMoves"));
+TRACE_DECLARE_INT_COUNTER(SavedMovesHighWaterMark, TEXT("CharacterMotion/SavedMovesHighWaterMark"));
+
+namespace MotionStats
+{
+	/* Counts values in power of two buckets: [0, 1), [1, 2), [2, 4)... the last bucket takes everything above */
+	struct FHistogram
+	{
+		static constexpr int32 NumBuckets = 14;
+
+		uint32 Buckets[NumBuckets] = {};
+		uint32 NumValues = 0;
+
+		void Add(uint32 Value)
+		{
+			const int32 Bucket = Value == 0 ? 0 : FMath::Min<int32>(FMath::FloorLog2(Value) + 1, NumBuckets - 1);
+			++Buckets[Bucket];
+			++NumValues;
+		}
+
+		void Reset()
+		{
+			FMemory::Memzero(Buckets);
+			NumValues = 0;
+		}
+
+		void Dump(const TCHAR* Name, const TCHAR* Unit) const
+		{
+			UE_LOG(LogTemp, Display, TEXT("%s: %u values"), Name, NumValues);
+			for (int32 Bucket = 0; Bucket < NumBuckets; ++Bucket)
+			{
+				const uint32 Min = Bucket == 0 ? 0 : 1u << (Bucket - 1);
+				if (Bucket == NumBuckets - 1)
+				{
+					UE_LOG(LogTemp, Display, TEXT("  >= %5u %s: %u"), Min, Unit, Buckets[Bucket]);
+				}
+				else
+				{
+					UE_LOG(LogTemp, Display, TEXT("  [%5u, %5u) %s: %u"), Min, 1u << Bucket, Unit, Buckets[Bucket]);
+				}
+			}
+		}
+	};
+
+	// Game thread only, like the movement code feeding them
+	static FHistogram AckLatencyHistogram;
+	static FHistogram MoveMotionBitsHistogram;
+
+	static FAutoConsoleCommand DumpCommand(
+		TEXT("p.MotionStats.Dump"),
+		TEXT("Logs the motion ack latency and move motion bits histograms."),
+		FConsoleCommandDelegate::CreateLambda([]()
+		{
+			AckLatencyHistogram.Dump(TEXT("Motion ack latency"), TEXT("ms"));
+			MoveMotionBitsHistogram.Dump(TEXT("Motion bits per move"), TEXT("bits"));
+		}));
+
+	static FAutoConsoleCommand ResetCommand(
+		TEXT("p.MotionStats.Reset"),
+		TEXT("Clears the motion histograms."),
+		FConsoleCommandDelegate::CreateLambda([]()
+		{
+			AckLatencyHistogram.Reset();
+			MoveMotionBitsHistogram.Reset();
+		}));
+
+	void OnMotionStarted()
+	{
+		INC_DWORD_STAT(STAT_MotionsStarted);
+		TRACE_COUNTER_INCREMENT(MotionsStarted);
+	}
+
+	void OnMotionAcked(double LatencySeconds)
+	{
+		INC_DWORD_STAT(STAT_MotionsAcked);
+		TRACE_COUNTER_INCREMENT(MotionsAcked);
+
+		const uint32 LatencyMs = (uint32)FMath::Max(0.0, LatencySeconds * 1000.0);
+		AckLatencyHistogram.Add(LatencyMs);
+
+		UE_TRACE_LOG(CharacterMotion, Ack, MotionChannel)
+			<< Ack.Cycle(FPlatformTime::Cycles64())
+			<< Ack.LatencyMs(LatencyMs);
+	}
+
+	void OnMotionResumed()
+	{
+		INC_DWORD_STAT(STAT_MotionsResumed);
+		TRACE_COUNTER_INCREMENT(MotionsResumed);
+	}
+
+	void OnMotionDropped()
+	{
+		INC_DWORD_STAT(STAT_MotionsDropped);
+		TRACE_COUNTER_INCREMENT(MotionsDropped);
+	}
+
+	void OnMotionStartAccepted()
+	{
+		INC_DWORD_STAT(STAT_MotionStartsAccepted);
+		TRACE_COUNTER_INCREMENT(MotionStartsAccepted);
+	}
+
+	void OnMotionStartThrottled()
+	{
+		INC_DWORD_STAT(STAT_MotionStartsThrottled);
+		TRACE_COUNTER_INCREMENT(MotionStartsThrottled);
+	}
+
+	void OnSavedMoveReused()
+	{
+		INC_DWORD_STAT(STAT_SavedMovesReused);
+		TRACE_COUNTER_INCREMENT(SavedMovesReused);
+	}
+
+	void OnSavedMoveAllocated()
+	{
+		INC_DWORD_STAT(STAT_SavedMovesAllocated);
+		TRACE_COUNTER_INCREMENT(SavedMovesAllocated);
+	}
+
+	void OnSavedMoveDropped()
+	{
+		INC_DWORD_STAT(STAT_SavedMovesDropped);
+		TRACE_COUNTER_INCREMENT(SavedMovesDropped);
+	}
+
+	void OnSavedMovePoolUsage(int32 NumFreeMoves, int32 HighWaterMark)
+	{
+		SET_DWORD_STAT(STAT_FreeSavedMoves, NumFreeMoves);
+		SET_DWORD_STAT(STAT_SavedMovesHighWaterMark, HighWaterMark);
+		TRACE_COUNTER_SET(FreeSavedMoves, NumFreeMoves);
+		TRACE_COUNTER_SET(SavedMovesHighWaterMark, HighWaterMark);
+	}
+
+	void OnMoveMotionBits(uint32 NumBits)
+	{
+		MoveMotionBitsHistogram.Add(NumBits);
+
+		UE_TRACE_LOG(CharacterMotion, MoveBits, MotionChannel)
+			<< MoveBits.Cycle(FPlatformTime::Cycles64())
+			<< MoveBits.Bits(NumBits);
+	}
+}
+
+#endif
@@ -0,0 +1,70 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+
+// Stats, trace counters and histograms of the motion prediction pipeline. Compiled out of shipping builds unless the target defines MOTION_STATS=1.
+#ifndef MOTION_STATS
+#define MOTION_STATS !UE_BUILD_SHIPPING
+#endif
+
+#if MOTION_STATS
+
+#include "Trace/Trace.h"
+
+DECLARE_STATS_GROUP(TEXT("CharacterMotion"), STATGROUP_CharacterMotion, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("PhysCustomMotion"), STAT_PhysCustomMotion, STATGROUP_CharacterMotion, MYPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Motion NetSerialize"), STAT_MotionNetSerialize, STATGROUP_CharacterMotion, MYPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Move Serialize"), STAT_MoveSerialize, STATGROUP_CharacterMotion, MYPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("ServerMove_PerformMovement"), STAT_ServerMovePerformMovement, STATGROUP_CharacterMotion, MYPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Batched Motion Evaluate"), STAT_BatchedMotionEvaluate, STATGROUP_CharacterMotion, MYPROJECT_API);
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Motions Started"), STAT_MotionsStarted, STATGROUP_CharacterMotion, MYPROJECT_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Motions Acked"), STAT_MotionsAcked, STATGROUP_CharacterMotion, MYPROJECT_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Motions Resumed After Correction"), STAT_MotionsResumed, STATGROUP_CharacterMotion, MYPROJECT_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Motions Dropped"), STAT_MotionsDropped, STATGROUP_CharacterMotion, MYPROJECT_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Motion Starts Accepted"), STAT_MotionStartsAccepted, STATGROUP_CharacterMotion, MYPROJECT_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Motion Starts Throttled"), STAT_MotionStartsThrottled, STATGROUP_CharacterMotion, MYPROJECT_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Saved Moves Reused"), STAT_SavedMovesReused, STATGROUP_CharacterMotion, MYPROJECT_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Saved Moves Allocated"), STAT_SavedMovesAllocated, STATGROUP_CharacterMotion, MYPROJECT_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Saved Moves Dropped"), STAT_SavedMovesDropped, STATGROUP_CharacterMotion, MYPROJECT_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Free Saved Moves"), STAT_FreeSavedMoves, STATGROUP_CharacterMotion, MYPROJECT_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Saved Moves High Water Mark"), STAT_SavedMovesHighWaterMark, STATGROUP_CharacterMotion, MYPROJECT_API);
+
+UE_TRACE_CHANNEL_EXTERN(MotionChannel, MYPROJECT_API);
+
+namespace MotionStats
+{
+	void OnMotionStarted();
+	void OnMotionAcked(double LatencySeconds);
+	void OnMotionResumed();
+	void OnMotionDropped();
+
+	/* Motion starts of clients the server took from their budget, or rejected because it was empty */
+	void OnMotionStartAccepted();
+	void OnMotionStartThrottled();
+
+	/* Client saved moves taken from FreeMoves, allocated because it was empty, or deleted because it was full */
+	void OnSavedMoveReused();
+	void OnSavedMoveAllocated();
+	void OnSavedMoveDropped();
+
+	/* Moves left in FreeMoves after a saved move was taken from it, and the most moves that were in use at once */
+	void OnSavedMovePoolUsage(int32 NumFreeMoves, int32 HighWaterMark);
+
+	/* Bits of motion payload carried by a move sent to the server */
+	void OnMoveMotionBits(uint32 NumBits);
+}
+
+#define MOTION_STAT(Call) MotionStats::Call
+#define MOTION_SCOPE_CYCLE_COUNTER(Stat) SCOPE_CYCLE_COUNTER(Stat)
+
+#else
+
+#define MOTION_STAT(Call)
+#define MOTION_SCOPE_CYCLE_COUNTER(Stat)
+
+#endif
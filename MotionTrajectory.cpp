@@ -0,0 +1,85 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MotionTrajectory.h"
+
+// Clients and servers build the tables of deterministic motions on their own
+MOTION_FP_CONTRACT_OFF
+
+namespace MotionTrajectory
+{
+	// Points measured along each spline segment to estimate the path length
+	constexpr int32 LengthSamplesPerSegment = 16;
+
+	static float EvaluateCatmullRom(float P0, float P1, float P2, float P3, float T)
+	{
+		const float T2 = T * T;
+		const float T3 = T2 * T;
+		return 0.5f * ((2.0f * P1) + (P2 - P0) * T + (2.0f * P0 - 5.0f * P1 + 4.0f * P2 - P3) * T2 + (3.0f * P1 - P0 - 3.0f * P2 + P3) * T3);
+	}
+
+	// Per axis, the FVector operators are compiled outside of MOTION_FP_CONTRACT_OFF
+	static FVector EvaluateCatmullRom(const FVector& P0, const FVector& P1, const FVector& P2, const FVector& P3, float T)
+	{
+		return FVector(
+			EvaluateCatmullRom(P0.X, P1.X, P2.X, P3.X, T),
+			EvaluateCatmullRom(P0.Y, P1.Y, P2.Y, P3.Y, T),
+			EvaluateCatmullRom(P0.Z, P1.Z, P2.Z, P3.Z, T));
+	}
+}
+
+TSharedRef<const FMotionArcLengthTable> FMotionArcLengthTable::BuildCatmullRom(TArrayView<const FVector> SplinePoints)
+{
+	using namespace MotionTrajectory;
+
+	check(SplinePoints.Num() >= 2 && SplinePoints.Num() <= MaxSplinePoints);
+
+	TSharedRef<FMotionArcLengthTable> Table = MakeShared<FMotionArcLengthTable>();
+
+	// Sample the spline densely and accumulate the length up to each sample
+	TArray<FVector, TInlineAllocator<(MaxSplinePoints - 1) * LengthSamplesPerSegment + 1>> Samples;
+	TArray<float, TInlineAllocator<(MaxSplinePoints - 1) * LengthSamplesPerSegment + 1>> Lengths;
+
+	Samples.Add(SplinePoints[0]);
+	Lengths.Add(0.0f);
+
+	const int32 LastPoint = SplinePoints.Num() - 1;
+	for (int32 Segment = 0; Segment < LastPoint; ++Segment)
+	{
+		// The ends are extended by mirroring their neighbour, so that the spline starts and ends on them
+		const FVector& P1 = SplinePoints[Segment];
+		const FVector& P2 = SplinePoints[Segment + 1];
+		const FVector P0 = Segment > 0 ? SplinePoints[Segment - 1] : 2.0f * P1 - P2;
+		const FVector P3 = Segment + 2 <= LastPoint ? SplinePoints[Segment + 2] : 2.0f * P2 - P1;
+
+		for (int32 Step = 1; Step <= LengthSamplesPerSegment; ++Step)
+		{
+			const FVector Sample = Step == LengthSamplesPerSegment ? P2 : EvaluateCatmullRom(P0, P1, P2, P3, (float)Step / LengthSamplesPerSegment);
+			Lengths.Add(Lengths.Last() + MotionDeterminism::Dist(Samples.Last(), Sample));
+			Samples.Add(Sample);
+		}
+	}
+
+	// Resample at uniform lengths
+	Table->Length = Lengths.Last();
+
+	int32 Sample = 0;
+	for (int32 Index = 0; Index <= NumSegments; ++Index)
+	{
+		const float Length = Table->Length * Index / NumSegments;
+		while (Sample < Samples.Num() - 2 && Lengths[Sample + 1] < Length)
+		{
+			++Sample;
+		}
+
+		const float SampleLength = Lengths[Sample + 1] - Lengths[Sample];
+		const float Fraction = SampleLength > KINDA_SMALL_NUMBER ? FMath::Clamp((Length - Lengths[Sample]) / SampleLength, 0.0f, 1.0f) : 0.0f;
+		Table->Points[Index] = MotionDeterminism::Lerp(Samples[Sample], Samples[Sample + 1], Fraction);
+	}
+
+	Table->Points[NumSegments] = SplinePoints[LastPoint];
+	Table->Points[NumSegments + 1] = SplinePoints[LastPoint];
+
+	return Table;
+}
+
+MOTION_FP_CONTRACT_RESTORE
@@ -0,0 +1,71 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MotionDeterminism.h"
+#include "MotionTrajectory.generated.h"
+
+/* Path a motion follows from its start to its target */
+UENUM()
+enum class EMotionTrajectory : uint8
+{
+	// Straight line from the start to the target
+	Linear,
+	// Uniform Catmull-Rom spline from the start to the target through the control points, at constant speed along it
+	CatmullRom
+};
+
+MOTION_FP_CONTRACT_OFF
+
+/**
+ * Points of a spline trajectory resampled at uniform arc length, so that a fraction of the path length maps to a location
+ * with a single indexed lerp. Built once when a motion starts and shared by the copies of the motion.
+ */
+struct MYPROJECT_API FMotionArcLengthTable
+{
+	static constexpr int32 NumSegments = 64;
+
+	// Start, target and up to four control points in between
+	static constexpr int32 MaxSplinePoints = 6;
+
+	/* Location at the given fraction of the path length */
+	FVector Evaluate(float Alpha) const
+	{
+		const float Position = FMath::Clamp(Alpha * NumSegments, 0.0f, (float)NumSegments);
+		const int32 Index = (int32)Position;
+		return MotionDeterminism::Lerp(Points[Index], Points[Index + 1], Position - (float)Index);
+	}
+
+	/* Builds the table of the uniform Catmull-Rom spline going through the given points in order */
+	static TSharedRef<const FMotionArcLengthTable> BuildCatmullRom(TArrayView<const FVector> SplinePoints);
+
+	float Length = 0.0f;
+
+	// NumSegments + 1 points, plus a copy of the last one so that evaluating exactly at the end never reads out of bounds
+	FVector Points[NumSegments + 2];
+};
+
+/* Location along a trajectory at a fraction Alpha of it, specialized per kind so that linear motions do not pay for splines */
+template<EMotionTrajectory Kind>
+struct TMotionTrajectory;
+
+template<>
+struct TMotionTrajectory<EMotionTrajectory::Linear>
+{
+	static FVector EvaluateLocation(const FVector& Start, const FVector& Target, const FMotionArcLengthTable* ArcLengthTable, float Alpha)
+	{
+		return MotionDeterminism::Lerp(Start, Target, Alpha);
+	}
+};
+
+template<>
+struct TMotionTrajectory<EMotionTrajectory::CatmullRom>
+{
+	static FVector EvaluateLocation(const FVector& Start, const FVector& Target, const FMotionArcLengthTable* ArcLengthTable, float Alpha)
+	{
+		return ArcLengthTable ? ArcLengthTable->Evaluate(Alpha) : TMotionTrajectory<EMotionTrajectory::Linear>::EvaluateLocation(Start, Target, nullptr, Alpha);
+	}
+};
+
+MOTION_FP_CONTRACT_RESTORE
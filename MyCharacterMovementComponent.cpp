@@ -2,7 +2,20 @@
 
 #include "MyCharacterMovementComponent.h"
 #include "MyProjectCharacter.h"
+#include "MotionCurveCache.h"
+#include "CharacterMotionPresets.h"
+#include "MotionNetSerialization.h"
+#include "MotionRecorder.h"
+#include "CharacterMotionSubsystem.h"
 #include "DrawDebugHelpers.h"
+#include "GameFramework/GameStateBase.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/PlayerState.h"
+#include "Camera/PlayerCameraManager.h"
+#include "Components/CapsuleComponent.h"
+#include "Curves/CurveFloat.h"
+#include "Net/UnrealNetwork.h"
+#include "Serialization/BitReader.h"
 
 namespace MyCharacterMovementCVars
 {
@@ -10,246 +23,1792 @@ namespace MyCharacterMovementCVars
 	FAutoConsoleVariableRef CVarShowMotionDebug(
 		TEXT("p.ShowMotionDebug"),
 		ShowMotionDebug,
-		TEXT("Whether to draw motion debug.\n")
+		TEXT("Whether to draw the start and target of motions when they start, their steps are recorded by p.MotionRecorder.\n")
 		TEXT("0: Disable, 1: Enable"),
 		ECVF_Cheat);
+
+	int32 EnableMotionPathSweep = 1;
+	FAutoConsoleVariableRef CVarEnableMotionPathSweep(
+		TEXT("p.EnableMotionPathSweep"),
+		EnableMotionPathSweep,
+		TEXT("Whether sweeping motions sweep their whole path when they start, and only sweep per tick past the first blocked segment.\n")
+		TEXT("0: Disable, 1: Enable"),
+		ECVF_Default);
+
+	int32 MotionPathSweepSegments = 8;
+	FAutoConsoleVariableRef CVarMotionPathSweepSegments(
+		TEXT("p.MotionPathSweepSegments"),
+		MotionPathSweepSegments,
+		TEXT("Number of segments the path of a sweeping motion is split into when it is swept."),
+		ECVF_Default);
+
+	int32 EnableMotionValidation = 1;
+	FAutoConsoleVariableRef CVarEnableMotionValidation(
+		TEXT("p.EnableMotionValidation"),
+		EnableMotionValidation,
+		TEXT("Whether the server validates the motions started by clients before confirming them.\n")
+		TEXT("0: Disable, 1: Enable"),
+		ECVF_Default);
+
+	float MotionValidationMaxStartError = 150.0f;
+	FAutoConsoleVariableRef CVarMotionValidationMaxStartError(
+		TEXT("p.MotionValidationMaxStartError"),
+		MotionValidationMaxStartError,
+		TEXT("Largest distance allowed between the start of a client motion and the location of the character on the server."),
+		ECVF_Default);
+
+	float MotionValidationMaxDistance = 2000.0f;
+	FAutoConsoleVariableRef CVarMotionValidationMaxDistance(
+		TEXT("p.MotionValidationMaxDistance"),
+		MotionValidationMaxDistance,
+		TEXT("Largest distance allowed between the start and the target of a client motion."),
+		ECVF_Default);
+
+	int32 MotionValidationMaxDuration = 8;
+	FAutoConsoleVariableRef CVarMotionValidationMaxDuration(
+		TEXT("p.MotionValidationMaxDuration"),
+		MotionValidationMaxDuration,
+		TEXT("Longest duration in seconds allowed for a client motion that is not a preset. Always checked, even without p.EnableMotionValidation."),
+		ECVF_Default);
+
+	float MotionValidationCapsuleShrink = 5.0f;
+	FAutoConsoleVariableRef CVarMotionValidationCapsuleShrink(
+		TEXT("p.MotionValidationCapsuleShrink"),
+		MotionValidationCapsuleShrink,
+		TEXT("Amount the capsule is shrunk by when tracing the path of a client motion, so that grazing geometry is not a rejection."),
+		ECVF_Default);
+
+	int32 DeterministicMotion = 1;
+	FAutoConsoleVariableRef CVarDeterministicMotion(
+		TEXT("p.DeterministicMotion"),
+		DeterministicMotion,
+		TEXT("Whether the motions started by this client are deterministic: quantized like on the wire when they start and evaluated over whole millisecond steps.\n")
+		TEXT("The server follows what each motion says.\n")
+		TEXT("0: Disable, 1: Enable"),
+		ECVF_Default);
+
+	int32 EnableMotionReplayFastForward = 1;
+	FAutoConsoleVariableRef CVarEnableMotionReplayFastForward(
+		TEXT("p.EnableMotionReplayFastForward"),
+		EnableMotionReplayFastForward,
+		TEXT("Whether replaying a run of motion only saved moves after a correction only evaluates and moves to the state at the end of the run.\n")
+		TEXT("0: Disable, 1: Enable"),
+		ECVF_Default);
+
+	int32 ReplicateMotionToSimulatedProxies = 1;
+	FAutoConsoleVariableRef CVarReplicateMotionToSimulatedProxies(
+		TEXT("p.ReplicateMotionToSimulatedProxies"),
+		ReplicateMotionToSimulatedProxies,
+		TEXT("Whether the server replicates motions to simulated proxies when they start and stops replicating the movement until they end.\n")
+		TEXT("0: Disable, 1: Enable"),
+		ECVF_Default);
+
+	// LOD tiers of the motions evaluated by simulated proxies, set per platform in the device profiles
+	int32 EnableMotionLOD = 1;
+	FAutoConsoleVariableRef CVarEnableMotionLOD(
+		TEXT("p.MotionLOD.Enable"),
+		EnableMotionLOD,
+		TEXT("Whether simulated proxies evaluate replicated motions less often when they are far from the camera or off-screen.\n")
+		TEXT("0: Disable, 1: Enable"),
+		ECVF_Scalability);
+
+	float MotionLODMediumDistance = 2500.0f;
+	FAutoConsoleVariableRef CVarMotionLODMediumDistance(
+		TEXT("p.MotionLOD.MediumDistance"),
+		MotionLODMediumDistance,
+		TEXT("Distance to the camera from which simulated proxies evaluate their motion at the medium update rate."),
+		ECVF_Scalability);
+
+	float MotionLODFarDistance = 5000.0f;
+	FAutoConsoleVariableRef CVarMotionLODFarDistance(
+		TEXT("p.MotionLOD.FarDistance"),
+		MotionLODFarDistance,
+		TEXT("Distance to the camera from which simulated proxies evaluate their motion at the far update rate."),
+		ECVF_Scalability);
+
+	float MotionLODMediumUpdateRate = 15.0f;
+	FAutoConsoleVariableRef CVarMotionLODMediumUpdateRate(
+		TEXT("p.MotionLOD.MediumUpdateRate"),
+		MotionLODMediumUpdateRate,
+		TEXT("Number of times per second a medium LOD simulated proxy evaluates its motion."),
+		ECVF_Scalability);
+
+	float MotionLODFarUpdateRate = 4.0f;
+	FAutoConsoleVariableRef CVarMotionLODFarUpdateRate(
+		TEXT("p.MotionLOD.FarUpdateRate"),
+		MotionLODFarUpdateRate,
+		TEXT("Number of times per second a far or off-screen simulated proxy evaluates its motion."),
+		ECVF_Scalability);
+
+	float MotionSweepSubstepRadiusScale = 1.0f;
+	FAutoConsoleVariableRef CVarMotionSweepSubstepRadiusScale(
+		TEXT("p.MotionSweepSubstepRadiusScale"),
+		MotionSweepSubstepRadiusScale,
+		TEXT("Longest distance a sweeping motion moves in one sweep, as a multiple of the capsule radius. Faster steps are split in as many sweeps as needed.\n")
+		TEXT("0: Always sweep once per step"),
+		ECVF_Default);
+
+	int32 MotionSweepMaxSubsteps = 8;
+	FAutoConsoleVariableRef CVarMotionSweepMaxSubsteps(
+		TEXT("p.MotionSweepMaxSubsteps"),
+		MotionSweepMaxSubsteps,
+		TEXT("Maximum number of sweeps a motion step is split in."),
+		ECVF_Default);
+
+	// Motions a client can start on the server, whether sent with its moves or triggered by their flags
+	int32 EnableMotionStartBudget = 1;
+	FAutoConsoleVariableRef CVarEnableMotionStartBudget(
+		TEXT("p.MotionStartBudget.Enable"),
+		EnableMotionStartBudget,
+		TEXT("Whether the server rejects the motions a client starts faster than its budget, without reading them.\n")
+		TEXT("0: Disable, 1: Enable"),
+		ECVF_Default);
+
+	float MotionStartBudgetRate = 2.0f;
+	FAutoConsoleVariableRef CVarMotionStartBudgetRate(
+		TEXT("p.MotionStartBudget.Rate"),
+		MotionStartBudgetRate,
+		TEXT("Number of motion starts per second the budget of a client refills."),
+		ECVF_Default);
+
+	float MotionStartBudgetBurst = 4.0f;
+	FAutoConsoleVariableRef CVarMotionStartBudgetBurst(
+		TEXT("p.MotionStartBudget.Burst"),
+		MotionStartBudgetBurst,
+		TEXT("Number of motions a client can start back to back before being held to p.MotionStartBudget.Rate."),
+		ECVF_Default);
+}
+
+FCharacterMotionData::FCharacterMotionData(const FVector& InStartLocation, const FVector& InTargetLocation, const FRotator& InStartRotation, const FRotator& InTargetRotation, uint8 InDuration)
+{
+	StartLocation = InStartLocation;
+	TargetLocation = InTargetLocation;
+	StartRotation = InStartRotation;
+	TargetRotation = InTargetRotation;
+	Duration = InDuration;
+}
+
+bool FCharacterMotionData::ApplyPreset(int32 InPresetIndex)
+{
+	const UCharacterMotionPresetRegistry* PresetRegistry = UCharacterMotionPresetRegistry::Get();
+	const FCharacterMotionPreset* Preset = PresetRegistry ? PresetRegistry->GetPreset(InPresetIndex) : nullptr;
+	if (Preset == nullptr)
+	{
+		PresetIndex = NoPreset;
+		Duration = 0;
+		return false;
+	}
+
+	MovementSpeedCurve = Preset->MovementSpeedCurve;
+	MovementZMultiplierCurve = Preset->MovementZMultiplierCurve;
+	MaxZOffset = Preset->MaxZOffset;
+	Duration = Preset->Duration;
+	bSweepDuringMotion = Preset->bSweepDuringMotion;
+	MovementModeOnEnd = Preset->MovementModeOnEnd;
+	PresetIndex = (uint8)InPresetIndex;
+
+	return true;
+}
+
+bool FCharacterMotionData::AddControlPoint(const FVector& Location)
+{
+	if (NumControlPoints >= MaxControlPoints)
+	{
+		return false;
+	}
+
+	ControlPoints[NumControlPoints++] = Location;
+	Trajectory = EMotionTrajectory::CatmullRom;
+	return true;
+}
+
+void FCharacterMotionData::BakeCurves()
+{
+	FMotionCurveCache& CurveCache = FMotionCurveCache::Get();
+	for (const TSoftObjectPtr<UCurveFloat>* Curve : { &MovementSpeedCurve, &MovementZMultiplierCurve })
+	{
+		if (!Curve->IsNull() && !Curve->IsValid())
+		{
+			// Still streaming in, the registry bakes it when it lands. Loading it here would hitch the game thread.
+			static TSet<FSoftObjectPath> UnloadedCurves;
+			bool bAlreadyWarned = false;
+			UnloadedCurves.Add(Curve->ToSoftObjectPath(), &bAlreadyWarned);
+			UE_CLOG(!bAlreadyWarned, LogTemp, Warning, TEXT("FCharacterMotionData::BakeCurves - %s is not loaded yet, the motion goes without it"), *Curve->ToString());
+		}
+	}
+	SpeedCurveHandle = CurveCache.FindOrBake(MovementSpeedCurve.Get());
+	ZMultiplierCurveHandle = CurveCache.FindOrBake(MovementZMultiplierCurve.Get());
+
+	ArcLengthTable.Reset();
+	if (Trajectory == EMotionTrajectory::CatmullRom)
+	{
+		TArray<FVector, TInlineAllocator<FMotionArcLengthTable::MaxSplinePoints>> SplinePoints;
+		SplinePoints.Add(StartLocation);
+		for (int32 Index = 0; Index < NumControlPoints; ++Index)
+		{
+			SplinePoints.Add(ControlPoints[Index]);
+		}
+		SplinePoints.Add(TargetLocation);
+
+		ArcLengthTable = FMotionArcLengthTable::BuildCatmullRom(SplinePoints);
+	}
+}
+
+MOTION_FP_CONTRACT_OFF
+
+bool FCharacterMotionData::EvaluatePoseAt(float Time, FVector& OutLocation, FRotator& OutRotation) const
+{
+	return EvaluatePoseAtClock(bDeterministic ? (float)FMath::RoundToInt(Time * 1000.0f) : Time, OutLocation, OutRotation);
+}
+
+bool FCharacterMotionData::EvaluatePoseAtClock(float ClockTime, FVector& OutLocation, FRotator& OutRotation) const
+{
+	switch (Trajectory)
+	{
+	case EMotionTrajectory::CatmullRom:
+		return EvaluatePoseAtClockImpl<EMotionTrajectory::CatmullRom>(ClockTime, OutLocation, OutRotation);
+	default:
+		return EvaluatePoseAtClockImpl<EMotionTrajectory::Linear>(ClockTime, OutLocation, OutRotation);
+	}
+}
+
+template<EMotionTrajectory Kind>
+bool FCharacterMotionData::EvaluatePoseAtClockImpl(float ClockTime, FVector& OutLocation, FRotator& OutRotation) const
+{
+	const float MoveValue = FMath::Min(1.0f, ClockTime / GetClockDuration());
+	const bool bEnded = FMath::IsNearlyEqual(MoveValue, 1.0f);
+
+	float LerpValue = bEnded ? 1.0f : MoveValue;
+
+	const FMotionCurveCache& CurveCache = FMotionCurveCache::Get();
+
+	if (!bEnded && SpeedCurveHandle != INDEX_NONE)
+	{
+		LerpValue = CurveCache.Evaluate(SpeedCurveHandle, LerpValue);
+	}
+
+	OutLocation = TMotionTrajectory<Kind>::EvaluateLocation(StartLocation, TargetLocation, ArcLengthTable.Get(), LerpValue);
+	OutRotation = MotionDeterminism::Lerp(StartRotation, TargetRotation, LerpValue);
+
+	if (!bEnded && ZMultiplierCurveHandle != INDEX_NONE)
+	{
+		const float ZOffset = MaxZOffset * CurveCache.Evaluate(ZMultiplierCurveHandle, LerpValue);
+		OutLocation.Z += ZOffset;
+	}
+
+	return bEnded;
+}
+
+MOTION_FP_CONTRACT_RESTORE
+
+bool FCharacterMotionData::NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess)
+{
+	MOTION_SCOPE_CYCLE_COUNTER(STAT_MotionNetSerialize);
+
+	bOutSuccess = true;
+	MotionNetSerialization::SerializeMotion(Ar, Map, *this, FIntVector::ZeroValue, bOutSuccess);
+	return !Ar.IsError();
+}
+
+static_assert(FCharacterMotionQueue::MaxPendingMotions + 1 <= MotionNetSerialization::MaxMotionsPerMove, "The move motion budget does not cover a full queue");
+
+bool FCharacterMotionQueue::Enqueue(const FCharacterMotionData& Motion)
+{
+	if (GetNumPending() >= MaxPendingMotions)
+	{
+		return false;
+	}
+
+	// Free slots first, then the oldest finished motion
+	FEntry* Slot = nullptr;
+	for (FEntry& Entry : Entries)
+	{
+		if (Entry.State == EEntryState::Free)
+		{
+			Slot = &Entry;
+			break;
+		}
+
+		if (Entry.State == EEntryState::Finished && (Slot == nullptr || IsNewerSequence(Slot->Motion.Sequence, Entry.Motion.Sequence)))
+		{
+			Slot = &Entry;
+		}
+	}
+
+	if (Slot == nullptr)
+	{
+		return false;
+	}
+
+	Slot->Motion = Motion;
+	Slot->State = EEntryState::Pending;
+	return true;
+}
+
+bool FCharacterMotionQueue::PopPending(FCharacterMotionData& OutMotion)
+{
+	FEntry* Oldest = nullptr;
+	for (FEntry& Entry : Entries)
+	{
+		if (Entry.State == EEntryState::Pending && (Oldest == nullptr || IsNewerSequence(Oldest->Motion.Sequence, Entry.Motion.Sequence)))
+		{
+			Oldest = &Entry;
+		}
+	}
+
+	if (Oldest == nullptr)
+	{
+		return false;
+	}
+
+	Oldest->State = EEntryState::Active;
+	OutMotion = Oldest->Motion;
+	return true;
+}
+
+const FCharacterMotionData* FCharacterMotionQueue::Activate(uint8 Sequence)
+{
+	FEntry* Activated = Find(Sequence);
+	if (Activated == nullptr)
+	{
+		return nullptr;
+	}
+
+	for (FEntry& Entry : Entries)
+	{
+		if (Entry.State == EEntryState::Active || Entry.State == EEntryState::Finished)
+		{
+			Entry.State = IsNewerSequence(Entry.Motion.Sequence, Sequence) ? EEntryState::Pending : EEntryState::Finished;
+		}
+	}
+
+	Activated->State = EEntryState::Active;
+	return &Activated->Motion;
+}
+
+void FCharacterMotionQueue::SetFinished(uint8 Sequence)
+{
+	if (FEntry* Entry = Find(Sequence))
+	{
+		Entry->State = EEntryState::Finished;
+	}
+}
+
+void FCharacterMotionQueue::Remove(uint8 Sequence)
+{
+	if (FEntry* Entry = Find(Sequence))
+	{
+		Entry->Motion.Clear();
+		Entry->State = EEntryState::Free;
+	}
+}
+
+void FCharacterMotionQueue::AckUpTo(uint8 Sequence)
+{
+	for (FEntry& Entry : Entries)
+	{
+		if (Entry.State != EEntryState::Free && !Entry.Motion.IsAcked() && !IsNewerSequence(Entry.Motion.Sequence, Sequence))
+		{
+			Entry.Motion.Ack();
+			MOTION_STAT(OnMotionAcked(FPlatformTime::Seconds() - Entry.Motion.RequestTime));
+		}
+	}
+}
+
+void FCharacterMotionQueue::GetUnackedPending(TArray<FCharacterMotionData*, TInlineAllocator<MaxPendingMotions>>& OutMotions)
+{
+	OutMotions.Reset();
+	for (FEntry& Entry : Entries)
+	{
+		if (Entry.State == EEntryState::Pending && !Entry.Motion.IsAcked())
+		{
+			OutMotions.Add(&Entry.Motion);
+		}
+	}
+
+	OutMotions.Sort([](const FCharacterMotionData& A, const FCharacterMotionData& B) { return IsNewerSequence(B.Sequence, A.Sequence); });
+}
+
+int32 FCharacterMotionQueue::GetNumPending() const
+{
+	int32 NumPending = 0;
+	for (const FEntry& Entry : Entries)
+	{
+		NumPending += Entry.State == EEntryState::Pending ? 1 : 0;
+	}
+	return NumPending;
+}
+
+FCharacterMotionQueue::FEntry* FCharacterMotionQueue::Find(uint8 Sequence)
+{
+	for (FEntry& Entry : Entries)
+	{
+		if (Entry.State != EEntryState::Free && Entry.Motion.Sequence == Sequence)
+		{
+			return &Entry;
+		}
+	}
+	return nullptr;
+}
+
+void FCharacterNetworkMoveData_Custom::ClientFillNetworkMoveData(const FSavedMove_Character& ClientMove, ENetworkMoveType MoveType)
+{
+	Super::ClientFillNetworkMoveData(ClientMove, MoveType);
+
+	const FSavedMove_Character_Custom& ClientMoveCustom = static_cast<const FSavedMove_Character_Custom&>(ClientMove);
+
+	bMotionDataValid = ClientMoveCustom.SavedMotionData.bHasValidData;
+	LatestMotionSequence = ClientMoveCustom.SavedMotionData.LatestSequence;
+	MotionTriggerSequence = ClientMoveCustom.MotionTriggerSequence;
+}
+
+bool FCharacterNetworkMoveData_Custom::Serialize(UCharacterMovementComponent& CharacterMovement, FArchive& Ar, UPackageMap* PackageMap, ENetworkMoveType MoveType)
+{
+	MOTION_SCOPE_CYCLE_COUNTER(STAT_MoveSerialize);
+
+	bool bReturn = Super::Serialize(CharacterMovement, Ar, PackageMap, MoveType);
+	if (bReturn)
+	{
+		UMyCharacterMovementComponent* MyMoveComp = Cast<UMyCharacterMovementComponent>(&CharacterMovement);
+		const bool bIsSaving = Ar.IsSaving();
+
+		// Every motion the server has not acked yet is sent with each move, the queued ones before the current one ends
+		TArray<FCharacterMotionData*, TInlineAllocator<FCharacterMotionQueue::MaxPendingMotions + 1>> SerializingMotions;
+		if (bIsSaving)
+		{
+			// Triggered motions only travel as the compressed flags of the move that started them, along with their sequence.
+			// Old moves resent with a new one must not carry motions started after them, the server only takes motions newer than the last one it received.
+			auto ShouldSend = [this](const FCharacterMotionData& Motion)
+			{
+				return !Motion.IsTriggered() && !FCharacterMotionQueue::IsNewerSequence(Motion.Sequence, LatestMotionSequence);
+			};
+
+			FCharacterMotionData& CurrentMotionData = MyMoveComp->GetCurrentMotionData();
+			if (bMotionDataValid && CurrentMotionData.HasValidData() && !CurrentMotionData.IsAcked() && ShouldSend(CurrentMotionData))
+			{
+				SerializingMotions.Add(&CurrentMotionData);
+			}
+
+			TArray<FCharacterMotionData*, TInlineAllocator<FCharacterMotionQueue::MaxPendingMotions>> PendingMotions;
+			MyMoveComp->MotionQueue.GetUnackedPending(PendingMotions);
+			for (FCharacterMotionData* PendingMotion : PendingMotions)
+			{
+				if (ShouldSend(*PendingMotion))
+				{
+					SerializingMotions.Add(PendingMotion);
+				}
+			}
+		}
+
+		uint32 NumMotions = SerializingMotions.Num();
+		Ar.SerializeBits(&NumMotions, MotionNetSerialization::MotionCountBits);
+		if (NumMotions > FCharacterMotionQueue::MaxPendingMotions + 1)
+		{
+			// More than a client can send, the payloads after it can't be trusted to line up
+			Ar.SetError();
+			return false;
+		}
+
+		MotionBits = MotionNetSerialization::MotionCountBits;
+
+		if ((CompressedMoveFlags & FSavedMove_Character_Custom::MotionTriggerMask) != 0)
+		{
+			Ar.SerializeBits(&MotionTriggerSequence, MotionNetSerialization::MotionSequenceBits);
+			MotionBits += MotionNetSerialization::MotionSequenceBits;
+		}
+
+		if (!bIsSaving)
+		{
+			ThrottledMotionMask = 0;
+			NetMotions.SetNum(NumMotions);
+			for (uint32 MotionIndex = 0; MotionIndex < NumMotions; ++MotionIndex)
+			{
+				NetMotions[MotionIndex] = FCharacterMotionData();
+				SerializingMotions.Add(&NetMotions[MotionIndex]);
+			}
+		}
+
+		const FIntVector Origin = SerializingMotions.Num() > 0 ? MotionNetSerialization::GetMoveOrigin(Location, bIsSaving) : FIntVector::ZeroValue;
+		for (int32 MotionIndex = 0; MotionIndex < SerializingMotions.Num() && bReturn; ++MotionIndex)
+		{
+			FCharacterMotionData* SerializingMotionData = SerializingMotions[MotionIndex];
+			Ar.SerializeBits(&SerializingMotionData->Sequence, MotionNetSerialization::MotionSequenceBits);
+
+			uint32 PayloadBits = 0;
+			if (bIsSaving)
+			{
+				// Written aside first, its size goes before it
+				FBitWriter& PayloadWriter = MyMoveComp->MotionPayloadWriter;
+				PayloadWriter.Reset();
+				MotionNetSerialization::SerializeMotion(PayloadWriter, PackageMap, *SerializingMotionData, Origin, bReturn);
+				bReturn &= !PayloadWriter.IsError();
+
+				PayloadBits = (uint32)PayloadWriter.GetNumBits();
+				Ar.SerializeBits(&PayloadBits, MotionNetSerialization::MotionPayloadSizeBits);
+				Ar.SerializeBits(PayloadWriter.GetData(), PayloadBits);
+			}
+			else
+			{
+				Ar.SerializeBits(&PayloadBits, MotionNetSerialization::MotionPayloadSizeBits);
+				if (PayloadBits > MotionNetSerialization::MaxMotionBits)
+				{
+					Ar.SetError();
+					bReturn = false;
+					break;
+				}
+
+				bool bThrottled = false;
+				if (MyMoveComp->ServerShouldReadMotion(SerializingMotionData->Sequence, bThrottled))
+				{
+					// Packed moves are always read from a bit reader, a payload that doesn't read back to its own size is corrupt
+					const FBitReader& PayloadReader = static_cast<const FBitReader&>(Ar);
+					const int64 PayloadStart = PayloadReader.GetPosBits();
+					MotionNetSerialization::SerializeMotion(Ar, PackageMap, *SerializingMotionData, Origin, bReturn);
+					if (PayloadReader.GetPosBits() - PayloadStart != PayloadBits)
+					{
+						Ar.SetError();
+						bReturn = false;
+						break;
+					}
+				}
+				else
+				{
+					// Resent or over budget, skipped without reading it. The motion is left without data, only its sequence is known.
+					uint8 SkippedPayload[(MotionNetSerialization::MaxMotionBits + 7) / 8];
+					Ar.SerializeBits(SkippedPayload, PayloadBits);
+					ThrottledMotionMask |= bThrottled ? (uint8)(1 << MotionIndex) : 0;
+				}
+			}
+
+			MotionBits += MotionNetSerialization::MotionSequenceBits + MotionNetSerialization::MotionPayloadSizeBits + PayloadBits;
+		}
+
+		MyMoveComp->LastMoveMotionBits = MotionBits;
+
+		if (bIsSaving)
+		{
+			// A triggered motion travels as the trigger code of the move that started it, resent with that move as long as it is important
+			const int32 NumMotionsSent = SerializingMotions.Num() + ((CompressedMoveFlags & FSavedMove_Character_Custom::MotionTriggerMask) != 0 ? 1 : 0);
+			MyMoveComp->MotionNetStats.MotionsSent += NumMotionsSent;
+			MyMoveComp->MotionNetStats.MotionsResentAsImportant += MoveType == ENetworkMoveType::OldMove ? NumMotionsSent : 0;
+			MOTION_STAT(OnMoveMotionBits(MotionBits));
+		}
+
+		bReturn &= !Ar.IsError();
+	}
+	return bReturn;
+}
+
+void FCharacterMoveResponseDataContainer_Custom::ServerFillResponseData(const UCharacterMovementComponent& CharacterMovement, const FClientAdjustment& PendingAdjustment)
+{
+	Super::ServerFillResponseData(CharacterMovement, PendingAdjustment);
+
+	const UMyCharacterMovementComponent* MyMoveComp = Cast<const UMyCharacterMovementComponent>(&CharacterMovement);
+	bServerMotionActive = MyMoveComp->MotionData.IsActive() && MyMoveComp->MotionData.HasValidData();
+	ServerMotionSequence = MyMoveComp->MotionData.Sequence;
+	ServerMotionTimeMs = (uint32)FMath::Max(0, FMath::RoundToInt(MyMoveComp->MotionData.GetTotalTime() * 1000.0f));
+	ServerLastReceivedMotionSequence = MyMoveComp->LastReceivedMotionSequence;
+	bMotionRejected = MyMoveComp->bMotionRejected;
+	RejectedMotionSequence = MyMoveComp->RejectedMotionSequence;
+	bMotionAck = MyMoveComp->bMotionAckPending;
+}
+
+bool FCharacterMoveResponseDataContainer_Custom::Serialize(UCharacterMovementComponent& CharacterMovement, FArchive& Ar, UPackageMap* PackageMap)
+{
+	bool bReturn = Super::Serialize(CharacterMovement, Ar, PackageMap);
+	if (bReturn && IsCorrection())
+	{
+		// Add here custom values to send to the client
+		uint8 bServerMotionActiveBit = bServerMotionActive;
+		Ar.SerializeBits(&bServerMotionActiveBit, 1);
+		bServerMotionActive = bServerMotionActiveBit != 0;
+
+		if (bServerMotionActive)
+		{
+			Ar.SerializeBits(&ServerMotionSequence, MotionNetSerialization::MotionSequenceBits);
+			Ar.SerializeBits(&ServerMotionTimeMs, MotionNetSerialization::MotionTimeMsBits);
+		}
+
+		Ar.SerializeBits(&ServerLastReceivedMotionSequence, MotionNetSerialization::MotionSequenceBits);
+
+		uint8 bMotionRejectedBit = bMotionRejected;
+		Ar.SerializeBits(&bMotionRejectedBit, 1);
+		bMotionRejected = bMotionRejectedBit != 0;
+
+		if (bMotionRejected)
+		{
+			Ar.SerializeBits(&RejectedMotionSequence, MotionNetSerialization::MotionSequenceBits);
+		}
+
+		bReturn &= !Ar.IsError();
+	}
+	else if (bReturn)
+	{
+		// Good moves only say up to which motion the server received, while the client is still sending some
+		uint8 bMotionAckBit = bMotionAck;
+		Ar.SerializeBits(&bMotionAckBit, 1);
+		bMotionAck = bMotionAckBit != 0;
+
+		if (bMotionAck)
+		{
+			Ar.SerializeBits(&ServerLastReceivedMotionSequence, MotionNetSerialization::MotionSequenceBits);
+		}
+
+		bReturn &= !Ar.IsError();
+	}
+	return bReturn;
+}
+
+UMyCharacterMovementComponent::UMyCharacterMovementComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+	, MotionPayloadWriter(MotionNetSerialization::MaxMotionBits)
+{
+	SetNetworkMoveDataContainer(CustomNetworkMoveDataContainer);
+	SetMoveResponseDataContainer(CustomMoveResponseContainer);
+
+	// Replicates the motion to simulated proxies
+	SetIsReplicatedByDefault(true);
+
+	MotionValidationTraceDelegate.BindUObject(this, &UMyCharacterMovementComponent::OnMotionValidationTraceDone);
+
+	MotionNetSerialization::RegisterPackedMovementBits();
+}
+
+void UMyCharacterMovementComponent::ServerMove_PerformMovement(const FCharacterNetworkMoveData& MoveData)
+{
+	MOTION_SCOPE_CYCLE_COUNTER(STAT_ServerMovePerformMovement);
+
+	const FCharacterNetworkMoveData_Custom* NetMoveData = static_cast<const FCharacterNetworkMoveData_Custom*>(&MoveData);
+	MotionTriggerSequence = NetMoveData->MotionTriggerSequence;
+
+	if (NetMoveData->NetMotions.Num() > 0)
+	{
+		// The client sends its motions until it hears they were received, answer the next response without waiting for the good move ack interval
+		bMotionAckPending = true;
+		if (FNetworkPredictionData_Server_Character* ServerData = GetPredictionData_Server_Character())
+		{
+			ServerData->ServerLastClientGoodMoveAckTime = -1.0f;
+		}
+	}
+
+	for (int32 MotionIndex = 0; MotionIndex < NetMoveData->NetMotions.Num(); ++MotionIndex)
+	{
+		const FCharacterMotionData& NetMotionData = NetMoveData->NetMotions[MotionIndex];
+		const bool bThrottled = (NetMoveData->ThrottledMotionMask & (1 << MotionIndex)) != 0;
+
+		// The client sends every motion until it is acked, only the ones received for the first time are started or queued
+		if ((!bThrottled && !NetMotionData.HasValidData()) || !FCharacterMotionQueue::IsNewerSequence(NetMotionData.Sequence, LastReceivedMotionSequence))
+		{
+			continue;
+		}
+
+		LastReceivedMotionSequence = NetMotionData.Sequence;
+		if (bMotionRejected && NetMotionData.Sequence == RejectedMotionSequence)
+		{
+			// The sequence wrapped around, the rejection was about an older motion
+			bMotionRejected = false;
+		}
+
+		if (bThrottled || !QueueMotion(NetMotionData))
+		{
+			ServerRejectMotion(NetMotionData);
+		}
+	}
+
+	Super::ServerMove_PerformMovement(MoveData);
+}
+
+bool UMyCharacterMovementComponent::ServerShouldReadMotion(uint8 Sequence, bool& bOutThrottled)
+{
+	bOutThrottled = false;
+	if (CharacterOwner == nullptr || CharacterOwner->GetRemoteRole() != ROLE_AutonomousProxy || IsNetMode(NM_Client))
+	{
+		// Not a server reading the moves of its client, such as the benchmark round trips
+		return true;
+	}
+
+	if (!FCharacterMotionQueue::IsNewerSequence(Sequence, LastReceivedMotionSequence))
+	{
+		// Resent until the client hears it was received, the server already has it
+		return false;
+	}
+
+	if (FCharacterMotionQueue::IsNewerSequence(LastReceivedMotionSequence, LastBudgetedMotionSequence))
+	{
+		// Every motion up to the last received one was charged, triggered ones included
+		LastBudgetedMotionSequence = LastReceivedMotionSequence;
+		ThrottledMotionSequences = 0;
+	}
+
+	if (!FCharacterMotionQueue::IsNewerSequence(Sequence, LastBudgetedMotionSequence))
+	{
+		// Charged when an earlier move of the same packet carried it
+		const uint8 Age = LastBudgetedMotionSequence - Sequence;
+		bOutThrottled = Age < 32 && (ThrottledMotionSequences & (1u << Age)) != 0;
+		return !bOutThrottled;
+	}
+
+	const uint8 Shift = Sequence - LastBudgetedMotionSequence;
+	ThrottledMotionSequences = Shift < 32 ? ThrottledMotionSequences << Shift : 0;
+	LastBudgetedMotionSequence = Sequence;
+
+	bOutThrottled = !ServerConsumeMotionStart();
+	ThrottledMotionSequences |= bOutThrottled ? 1u : 0u;
+	return !bOutThrottled;
+}
+
+bool UMyCharacterMovementComponent::ServerConsumeMotionStart()
+{
+	if (MyCharacterMovementCVars::EnableMotionStartBudget == 0
+		|| MotionStartBudget.TryConsume(GetWorld()->GetTimeSeconds(), MyCharacterMovementCVars::MotionStartBudgetRate, MyCharacterMovementCVars::MotionStartBudgetBurst))
+	{
+		MOTION_STAT(OnMotionStartAccepted());
+		return true;
+	}
+
+	UE_LOG(LogTemp, Verbose, TEXT("ServerConsumeMotionStart - %s is starting motions faster than p.MotionStartBudget.Rate allows, throttling"), *GetNameSafe(CharacterOwner));
+	MOTION_STAT(OnMotionStartThrottled());
+	return false;
+}
+
+bool FMotionStartBudget::TryConsume(float Time, float Rate, float Burst)
+{
+	if (Tokens < 0.0f)
+	{
+		// Starts full
+		Tokens = Burst;
+	}
+	else
+	{
+		Tokens = FMath::Min(Burst, Tokens + FMath::Max(0.0f, Time - LastRefillTime) * Rate);
+	}
+	LastRefillTime = Time;
+
+	if (Tokens < 1.0f)
+	{
+		return false;
+	}
+
+	Tokens -= 1.0f;
+	return true;
+}
+
+void UMyCharacterMovementComponent::ServerSendMoveResponse(const FClientAdjustment& PendingAdjustment)
+{
+	Super::ServerSendMoveResponse(PendingAdjustment);
+
+	bMotionAckPending = false;
+}
+
+void UMyCharacterMovementComponent::ClientHandleMoveResponse(const FCharacterMoveResponseDataContainer& MoveResponse)
+{
+	const FCharacterMoveResponseDataContainer_Custom& MoveResponseCustom = static_cast<const FCharacterMoveResponseDataContainer_Custom&>(MoveResponse);
+	if (MoveResponse.IsGoodMove() && MoveResponseCustom.bMotionAck)
+	{
+		AckMotionsUpTo(MoveResponseCustom.ServerLastReceivedMotionSequence);
+	}
+
+	Super::ClientHandleMoveResponse(MoveResponse);
+}
+
+bool UMyCharacterMovementComponent::ServerCheckClientError(float ClientTimeStamp, float DeltaTime, const FVector& Accel, const FVector& ClientLoc, const FVector& RelativeClientLoc, UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode)
+{
+	if (bMotionEndedThisMove)
+	{
+		// Where the client says it ended the move, against where the server did, before any correction
+		bMotionEndedThisMove = false;
+		const float MotionEndError = FVector::Dist(ClientLoc, UpdatedComponent->GetComponentLocation());
+		++MotionNetStats.MotionEnds;
+		MotionNetStats.TotalMotionEndError += MotionEndError;
+		MotionNetStats.MaxMotionEndError = FMath::Max(MotionNetStats.MaxMotionEndError, MotionEndError);
+	}
+
+	if (bForceMotionCorrection)
+	{
+		bForceMotionCorrection = false;
+		return true;
+	}
+
+	return Super::ServerCheckClientError(ClientTimeStamp, DeltaTime, Accel, ClientLoc, RelativeClientLoc, ClientMovementBase, ClientBaseBoneName, ClientMovementMode);
+}
+
+bool UMyCharacterMovementComponent::ServerValidateMotion(const FCharacterMotionData& NewMotionData) const
+{
+	// Preset settings come from the server's own table, the ones sent by the client must not let it fly or stay in the motion
+	if (!NewMotionData.HasPreset())
+	{
+		if (NewMotionData.MovementModeOnEnd != MOVE_Walking && NewMotionData.MovementModeOnEnd != MOVE_Falling)
+		{
+			return false;
+		}
+
+		if (NewMotionData.Duration > MyCharacterMovementCVars::MotionValidationMaxDuration)
+		{
+			return false;
+		}
+	}
+
+	if (MyCharacterMovementCVars::EnableMotionValidation == 0)
+	{
+		return true;
+	}
+
+	const FVector ServerLocation = UpdatedComponent->GetComponentLocation();
+	if (FVector::DistSquared(NewMotionData.StartLocation, ServerLocation) > FMath::Square(MyCharacterMovementCVars::MotionValidationMaxStartError))
+	{
+		return false;
+	}
+
+	for (int32 Index = 0; Index < NewMotionData.NumControlPoints; ++Index)
+	{
+		if (FVector::DistSquared(NewMotionData.StartLocation, NewMotionData.ControlPoints[Index]) > FMath::Square(MyCharacterMovementCVars::MotionValidationMaxDistance))
+		{
+			return false;
+		}
+	}
+
+	return FVector::DistSquared(NewMotionData.StartLocation, NewMotionData.TargetLocation) <= FMath::Square(MyCharacterMovementCVars::MotionValidationMaxDistance);
+}
+
+void UMyCharacterMovementComponent::ServerValidateMotionPath()
+{
+	++MotionValidationId;
+	PendingMotionValidationTraces = 0;
+	bMotionValidationBlocked = false;
+
+	// Sweeping motions are stopped by collision on the server already, only motions moving through geometry need checking
+	if (MyCharacterMovementCVars::EnableMotionValidation == 0 || MotionData.bSweepDuringMotion || !MotionData.IsActive())
+	{
+		return;
+	}
+
+	ValidatingMotionData = MotionData;
+	MotionValidationRestoreLocation = UpdatedComponent->GetComponentLocation();
+
+	const int32 NumSegments = FMath::Max(1, MyCharacterMovementCVars::MotionPathSweepSegments);
+	const FCollisionShape CapsuleShape = GetPawnCapsuleCollisionShape(SHRINK_AllCustom, MyCharacterMovementCVars::MotionValidationCapsuleShrink);
+	const FQuat CapsuleRotation = UpdatedComponent->GetComponentQuat();
+	const FCollisionObjectQueryParams ObjectQueryParams(ECC_WorldStatic);
+	const FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(MotionValidation), false, CharacterOwner);
+
+	FVector SegmentStart = MotionData.StartLocation;
+	for (int32 SegmentIndex = 1; SegmentIndex <= NumSegments; ++SegmentIndex)
+	{
+		FVector SegmentEnd;
+		FRotator SegmentEndRotation;
+		MotionData.EvaluatePoseAt((float)MotionData.Duration * SegmentIndex / NumSegments, SegmentEnd, SegmentEndRotation);
+
+		// Results land next frame, the motion keeps being simulated meanwhile
+		GetWorld()->AsyncSweepByObjectType(EAsyncTraceType::Single, SegmentStart, SegmentEnd, CapsuleRotation, ObjectQueryParams, CapsuleShape, QueryParams, &MotionValidationTraceDelegate, MotionValidationId);
+		++PendingMotionValidationTraces;
+
+		SegmentStart = SegmentEnd;
+	}
+}
+
+void UMyCharacterMovementComponent::OnMotionValidationTraceDone(const FTraceHandle& TraceHandle, FTraceDatum& TraceDatum)
+{
+	if (TraceDatum.UserData != MotionValidationId || PendingMotionValidationTraces == 0)
+	{
+		// Result of the validation of an older motion
+		return;
+	}
+
+	if (TraceDatum.OutHits.Num() > 0 && TraceDatum.OutHits[0].bBlockingHit)
+	{
+		bMotionValidationBlocked = true;
+	}
+
+	if (--PendingMotionValidationTraces == 0 && bMotionValidationBlocked)
+	{
+		// Undo the provisional motion and correct the client back to where it started
+		MotionQueue.Remove(MotionData.Sequence);
+		MotionData.Clear();
+		UpdateReplicatedMotion();
+		SetMovementMode(EMovementMode::MOVE_Walking);
+		UpdatedComponent->SetWorldLocation(MotionValidationRestoreLocation, false, nullptr, ETeleportType::TeleportPhysics);
+
+		ServerRejectMotion(ValidatingMotionData);
+
+		// Motions queued after it were meant to start where it ended, they are validated against where the character is now
+		StartNextMotion();
+	}
+}
+
+void UMyCharacterMovementComponent::ServerRejectMotion(const FCharacterMotionData& RejectedMotion)
+{
+	UE_LOG(LogTemp, Verbose, TEXT("ServerRejectMotion - rejecting motion from %s to %s"), *RejectedMotion.StartLocation.ToString(), *RejectedMotion.TargetLocation.ToString());
+	MOTION_STAT(OnMotionDropped());
+
+	RejectedMotionSequence = RejectedMotion.Sequence;
+	bMotionRejected = true;
+	bForceMotionCorrection = true;
+}
+
+void UMyCharacterMovementComponent::ClientAckGoodMove_Implementation(float TimeStamp)
+{
+	Super::ClientAckGoodMove_Implementation(TimeStamp);
+
+	FNetworkPredictionData_Client_Character_Custom* ClientData = static_cast<FNetworkPredictionData_Client_Character_Custom*>(GetPredictionData_Client_Character());
+	check(ClientData);
+
+	const FSavedMove_Character_Custom* LastAckedClientMoveCustom = static_cast<const FSavedMove_Character_Custom*>(ClientData->LastAckedMove.Get());
+	if (LastAckedClientMoveCustom)
+	{
+		// The server received every motion the client had started when it made this move
+		AckMotionsUpTo(LastAckedClientMoveCustom->SavedMotionData.LatestSequence);
+	}
+}
+
+void UMyCharacterMovementComponent::OnClientCorrectionReceived(FNetworkPredictionData_Client_Character& ClientData, float TimeStamp, FVector NewLocation, FVector NewVelocity, UPrimitiveComponent* NewBase, FName NewBaseBoneName, bool bHasBase, bool bBaseRelativePosition, uint8 ServerMovementMode)
+{
+	FCharacterMoveResponseDataContainer_Custom& MoveResponseDataCustom = static_cast<FCharacterMoveResponseDataContainer_Custom&>(GetMoveResponseDataContainer());
+	// Use MoveResponseDataCustom to read data sent from the server
+
+	++MotionNetStats.Corrections;
+	MotionNetStats.CorrectionsDuringMotion += MotionData.HasValidData() ? 1 : 0;
+	if (!bBaseRelativePosition)
+	{
+		const float CorrectionError = FVector::Dist(NewLocation, UpdatedComponent->GetComponentLocation());
+		MotionNetStats.TotalCorrectionError += CorrectionError;
+		MotionNetStats.MaxCorrectionError = FMath::Max(MotionNetStats.MaxCorrectionError, CorrectionError);
+
+		RecordMotionSample(MoveResponseDataCustom.ServerMotionTimeMs / 1000.0f, MoveResponseDataCustom.ServerMotionSequence, FMotionSample::Correction, &NewLocation);
+	}
+
+	if (MoveResponseDataCustom.bMotionRejected)
+	{
+		// The server refused the motion, drop it so that replaying the saved moves does not resume it
+		DropMotion(MoveResponseDataCustom.RejectedMotionSequence);
+	}
+
+	if (MotionData.IsActive() && MotionData.HasValidData())
+	{
+		MotionData.Stop();
+	}
+
+	const FSavedMove_Character_Custom* LastAckedClientMoveCustom = static_cast<const FSavedMove_Character_Custom*>(ClientData.LastAckedMove.Get());
+	if (LastAckedClientMoveCustom)
+	{
+		AckMotionsUpTo(LastAckedClientMoveCustom->SavedMotionData.LatestSequence);
+	}
+	AckMotionsUpTo(MoveResponseDataCustom.ServerLastReceivedMotionSequence);
+
+	// A triggered motion the server has not received by the corrected move was lost with its move, it is never sent again
+	TArray<uint8, TInlineAllocator<FCharacterMotionQueue::MaxPendingMotions + 1>> LostTriggeredMotions;
+	if (MotionData.IsTriggered() && !MotionData.IsAcked() && MotionData.TriggerTimeStamp <= TimeStamp)
+	{
+		LostTriggeredMotions.Add(MotionData.Sequence);
+	}
+
+	TArray<FCharacterMotionData*, TInlineAllocator<FCharacterMotionQueue::MaxPendingMotions>> PendingMotions;
+	MotionQueue.GetUnackedPending(PendingMotions);
+	for (const FCharacterMotionData* PendingMotion : PendingMotions)
+	{
+		if (PendingMotion->IsTriggered() && PendingMotion->TriggerTimeStamp <= TimeStamp)
+		{
+			LostTriggeredMotions.Add(PendingMotion->Sequence);
+		}
+	}
+
+	for (const uint8 Sequence : LostTriggeredMotions)
+	{
+		DropMotion(Sequence);
+	}
+
+	if (MoveResponseDataCustom.bServerMotionActive && RestoreMotion(MoveResponseDataCustom.ServerMotionSequence))
+	{
+		// Continue from the server's motion clock rather than from the saved moves, the replay advances it from there
+		ResumeMotion(MoveResponseDataCustom.ServerMotionTimeMs / 1000.0f);
+	}
+
+	Super::OnClientCorrectionReceived(ClientData, TimeStamp, NewLocation, NewVelocity, NewBase, NewBaseBoneName, bHasBase, bBaseRelativePosition, ServerMovementMode);
+}
+
+class FNetworkPredictionData_Client* UMyCharacterMovementComponent::GetPredictionData_Client() const
+{
+	if (ClientPredictionData == nullptr)
+	{
+		UMyCharacterMovementComponent* MutableThis = const_cast<UMyCharacterMovementComponent*>(this);
+		MutableThis->ClientPredictionData = new FNetworkPredictionData_Client_Character_Custom(*this);
+	}
+
+	return ClientPredictionData;
+}
+
+void UMyCharacterMovementComponent::UpdateFromCompressedFlags(uint8 Flags)
+{
+	Super::UpdateFromCompressedFlags(Flags);
+
+	// Only the server starts motions from the flags, a client replaying its saved moves restores the motions it already started
+	if (CharacterOwner && CharacterOwner->GetLocalRole() == ROLE_Authority)
+	{
+		const uint8 TriggerCode = (Flags & FSavedMove_Character_Custom::MotionTriggerMask) >> FSavedMove_Character_Custom::MotionTriggerShift;
+		PendingMotionTrigger = TriggerCode < (uint8)EMotionTrigger::MAX ? (EMotionTrigger)TriggerCode : EMotionTrigger::None;
+	}
+}
+
+void UMyCharacterMovementComponent::TriggerMotion(EMotionTrigger Trigger)
+{
+	PendingMotionTrigger = Trigger;
+}
+
+void UMyCharacterMovementComponent::UpdateCharacterStateBeforeMovement(float DeltaSeconds)
+{
+	Super::UpdateCharacterStateBeforeMovement(DeltaSeconds);
+
+	if (PendingMotionTrigger == EMotionTrigger::None || CharacterOwner == nullptr)
+	{
+		return;
+	}
+
+	const EMotionTrigger Trigger = PendingMotionTrigger;
+	PendingMotionTrigger = EMotionTrigger::None;
+
+	FCharacterMotionData NewMotion;
+	const bool bBuilt = BuildTriggeredMotion(Trigger, NewMotion);
+	if (bBuilt)
+	{
+		// Both sides build it from their own state, rounding it the way deterministic motions are leaves only differences above a unit
+		NewMotion.bDeterministic = true;
+		MotionNetSerialization::QuantizeMotion(NewMotion);
+	}
+
+	if (CharacterOwner->GetLocalRole() == ROLE_Authority && !CharacterOwner->IsLocallyControlled())
+	{
+		// Clients only send the triggers that started a motion on their side, with the sequence they gave it. Triggers lost on the way leave
+		// a gap the later sequences skip. It is taken even when the server can't build the motion, the rejection makes the client drop it.
+		if (!FCharacterMotionQueue::IsNewerSequence(MotionTriggerSequence, LastReceivedMotionSequence))
+		{
+			return;
+		}
+
+		LastReceivedMotionSequence = MotionTriggerSequence;
+		NewMotion.Sequence = MotionTriggerSequence;
+		if (bMotionRejected && NewMotion.Sequence == RejectedMotionSequence)
+		{
+			bMotionRejected = false;
+		}
+
+		if (!bBuilt || !ServerConsumeMotionStart() || !QueueMotion(NewMotion))
+		{
+			ServerRejectMotion(NewMotion);
+		}
+		return;
+	}
+
+	bMotionTriggerRefused = true;
+	if (!bBuilt)
+	{
+		return;
+	}
+
+	const FNetworkPredictionData_Client_Character* ClientData = CharacterOwner->GetLocalRole() == ROLE_AutonomousProxy ? GetPredictionData_Client_Character() : nullptr;
+	NewMotion.TriggerTimeStamp = ClientData ? ClientData->CurrentTimeStamp : 0.0f;
+
+	const uint8 PreviousMotionSequence = NextMotionSequence;
+	StartMotion(NewMotion);
+	bMotionTriggerRefused = NextMotionSequence == PreviousMotionSequence;
+	MotionTriggerSequence = NextMotionSequence;
+}
+
+bool UMyCharacterMovementComponent::BuildTriggeredMotion(EMotionTrigger Trigger, FCharacterMotionData& OutMotion) const
+{
+	const AMyProjectCharacter* MyCharacter = Cast<AMyProjectCharacter>(CharacterOwner);
+	if (MyCharacter == nullptr)
+	{
+		return false;
+	}
+
+	switch (Trigger)
+	{
+	case EMotionTrigger::Dash:
+		OutMotion = MyCharacter->MakePredictiveMotion();
+		return OutMotion.HasValidData();
+	default:
+		return false;
+	}
+}
+
+void UMyCharacterMovementComponent::PhysCustom(float deltaTime, int32 Iterations)
+{
+	if (MotionData.IsActive())
+	{
+		PhysCustomMotion(deltaTime);
+	}
+
+	Super::PhysCustom(deltaTime, Iterations);
+}
+
+void UMyCharacterMovementComponent::StartMotion(const FCharacterMotionData& NewMotionData)
+{
+	FCharacterMotionData NewMotion = NewMotionData;
+	NewMotion.Sequence = ++NextMotionSequence;
+
+	if (MyCharacterMovementCVars::DeterministicMotion != 0)
+	{
+		// Start from exactly what the server will receive
+		NewMotion.bDeterministic = true;
+		MotionNetSerialization::QuantizeMotion(NewMotion);
+	}
+#if MOTION_STATS
+	NewMotion.RequestTime = FPlatformTime::Seconds();
+#endif
+
+	if (!QueueMotion(NewMotion))
+	{
+		// custom motion already in progress and the queue is full, or it uses a curve that can't be sent
+		--NextMotionSequence;
+		MOTION_STAT(OnMotionDropped());
+		return;
+	}
+
+	++MotionNetStats.MotionsStarted;
+}
+
+bool UMyCharacterMovementComponent::QueueMotion(const FCharacterMotionData& NewMotionData)
+{
+	// A curve outside of the manifest would reach the other side as no curve, the motion would play differently there
+	const UCharacterMotionPresetRegistry* PresetRegistry = UCharacterMotionPresetRegistry::Get();
+	if (PresetRegistry && (!PresetRegistry->IsCurveSendable(NewMotionData.MovementSpeedCurve) || !PresetRegistry->IsCurveSendable(NewMotionData.MovementZMultiplierCurve)))
+	{
+		return false;
+	}
+
+	if (!MotionQueue.Enqueue(NewMotionData))
+	{
+		return false;
+	}
+
+	if (!MotionData.IsActive() && !MotionData.HasValidData())
+	{
+		StartNextMotion();
+	}
+
+	return true;
+}
+
+bool UMyCharacterMovementComponent::StartNextMotion()
+{
+	// Motions sent by a client are checked when they start, queued ones start where the previous one ended
+	const bool bValidateClientMotion = GetOwnerRole() == ROLE_Authority && CharacterOwner && !CharacterOwner->IsLocallyControlled();
+
+	FCharacterMotionData NextMotionData;
+	while (MotionQueue.PopPending(NextMotionData))
+	{
+		if (bValidateClientMotion && !ServerValidateMotion(NextMotionData))
+		{
+			MotionQueue.Remove(NextMotionData.Sequence);
+			ServerRejectMotion(NextMotionData);
+			continue;
+		}
+
+		MotionData = NextMotionData;
+		MotionData.BakeCurves();
+
+		ResumeMotion(0.0f);
+		SweepMotionPath(0.0f);
+
+		if (bValidateClientMotion)
+		{
+			ServerValidateMotionPath();
+		}
+
+		MOTION_STAT(OnMotionStarted());
+
+		if (MyCharacterMovementCVars::ShowMotionDebug != 0)
+		{
+			DrawDebugCapsule(GetWorld(), MotionData.StartLocation, CharacterOwner->GetSimpleCollisionHalfHeight(), CharacterOwner->GetSimpleCollisionRadius(), FQuat::Identity, FColor::Red, false, 15.0f);
+			DrawDebugCapsule(GetWorld(), MotionData.TargetLocation, CharacterOwner->GetSimpleCollisionHalfHeight(), CharacterOwner->GetSimpleCollisionRadius(), FQuat::Identity, FColor::Red, false, 15.0f);
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+bool UMyCharacterMovementComponent::RestoreMotion(uint8 Sequence)
+{
+	if (MotionData.HasValidData() && MotionData.Sequence == Sequence)
+	{
+		return true;
+	}
+
+	const FCharacterMotionData* RestoredMotionData = MotionQueue.Activate(Sequence);
+	if (RestoredMotionData == nullptr)
+	{
+		return false;
+	}
+
+	MotionData = *RestoredMotionData;
+	MotionData.BakeCurves();
+
+	// The path was swept for another motion
+	MotionPathProfile.Reset();
+
+	return true;
+}
+
+void UMyCharacterMovementComponent::DropMotion(uint8 Sequence)
+{
+	MotionQueue.Remove(Sequence);
+
+	if (MotionData.HasValidData() && MotionData.Sequence == Sequence)
+	{
+		MotionData.Clear();
+	}
+
+	MOTION_STAT(OnMotionDropped());
+}
+
+void UMyCharacterMovementComponent::AckMotionsUpTo(uint8 Sequence)
+{
+	if (MotionData.HasValidData() && !MotionData.IsAcked() && !FCharacterMotionQueue::IsNewerSequence(MotionData.Sequence, Sequence))
+	{
+		MotionData.Ack();
+	}
+
+	// The queue also holds the current motion and counts the acks
+	MotionQueue.AckUpTo(Sequence);
+}
+
+void UMyCharacterMovementComponent::PhysCustomMotion(float DeltaTime)
+{
+	MOTION_SCOPE_CYCLE_COUNTER(STAT_PhysCustomMotion);
+
+	MotionData.AdvanceTime(DeltaTime);
+
+	bSkippedMotionStep = bClientUpdating && bFastForwardMotionStep && CanFastForwardMotionStep();
+	if (bSkippedMotionStep)
+	{
+		// Another motion only move follows during this replay, the pose is only evaluated and applied by the last one of the run
+		FastForwardStartTime = FastForwardStartTime < 0.0f ? MotionData.TotalTime - DeltaTime : FastForwardStartTime;
+		return;
+	}
+
+	// The last step of a fast-forwarded run moves the character over the whole run
+	const float StepStartTime = FastForwardStartTime < 0.0f ? MotionData.TotalTime - DeltaTime : FastForwardStartTime;
+	const float StepTime = MotionData.TotalTime - StepStartTime;
+	FastForwardStartTime = -1.0f;
+
+	FVector NewLocation;
+	FRotator NewRotation;
+	const bool bEnded = MotionData.EvaluatePose(NewLocation, NewRotation);
+
+	// Moves along a path that was swept clear when the motion started don't need to sweep again
+	const bool bSweep = MotionData.bSweepDuringMotion && !IsMotionPathClear(StepStartTime, MotionData.TotalTime);
+
+	FHitResult Hit;
+	const int32 NumSubsteps = bSweep ? GetMotionSweepSubsteps(NewLocation - GetActorLocation()) : 1;
+	for (int32 Substep = 1; Substep < NumSubsteps; ++Substep)
+	{
+		// Follows the trajectory rather than the straight line to the pose, for splines and Z curves
+		FVector SubstepLocation;
+		FRotator SubstepRotation;
+		MotionData.EvaluatePoseAt(MotionData.TotalTime - StepTime * (NumSubsteps - Substep) / NumSubsteps, SubstepLocation, SubstepRotation);
+
+		SafeMoveUpdatedComponent(SubstepLocation - GetActorLocation(), SubstepRotation.Quaternion(), true, Hit, ETeleportType::TeleportPhysics);
+		if (Hit.IsValidBlockingHit())
+		{
+			// The remaining substeps would stop on the same hit
+			break;
+		}
+	}
+
+	if (!Hit.IsValidBlockingHit())
+	{
+		SafeMoveUpdatedComponent(NewLocation - GetActorLocation(), NewRotation.Quaternion(), bSweep, Hit, ETeleportType::TeleportPhysics);
+	}
+
+	RecordMotionSample(MotionData.GetTotalTime(), MotionData.Sequence, bEnded ? FMotionSample::Ended : 0);
+
+	if (bEnded)
+	{
+		bMotionEndedThisMove = CharacterOwner->GetLocalRole() == ROLE_Authority && !CharacterOwner->IsLocallyControlled();
+
+		SetMovementMode(MotionData.MovementModeOnEnd);
+		MotionQueue.SetFinished(MotionData.Sequence);
+		MotionData.Clear();
+		UpdateReplicatedMotion();
+
+		// Chained motions run back to back, the same way on the client and on the server
+		StartNextMotion();
+	}
 }
 
-FCharacterMotionData::FCharacterMotionData(const FVector& InStartLocation, const FVector& InTargetLocation, const FRotator& InStartRotation, const FRotator& InTargetRotation, uint8 InDuration)
+int32 UMyCharacterMovementComponent::GetMotionSweepSubsteps(const FVector& Delta) const
 {
-	StartLocation = InStartLocation;
-	TargetLocation = InTargetLocation;
-	StartRotation = InStartRotation;
-	TargetRotation = InTargetRotation;
-	Duration = InDuration;
+	const float MaxSubstepDistance = CharacterOwner->GetCapsuleComponent()->GetScaledCapsuleRadius() * MyCharacterMovementCVars::MotionSweepSubstepRadiusScale;
+	if (MaxSubstepDistance <= KINDA_SMALL_NUMBER)
+	{
+		return 1;
+	}
+
+	// Slow motions keep a single sweep, only the steps long enough to skip over thin geometry are split
+	return FMath::Clamp(FMath::CeilToInt(Delta.Size() / MaxSubstepDistance), 1, FMath::Max(1, MyCharacterMovementCVars::MotionSweepMaxSubsteps));
 }
 
-void FCharacterNetworkMoveData_Custom::ClientFillNetworkMoveData(const FSavedMove_Character& ClientMove, ENetworkMoveType MoveType)
+bool UMyCharacterMovementComponent::CanFastForwardMotionStep() const
 {
-	Super::ClientFillNetworkMoveData(ClientMove, MoveType);
-
-	const FSavedMove_Character_Custom& ClientMoveCustom = static_cast<const FSavedMove_Character_Custom&>(ClientMove);
+	if (FMath::IsNearlyEqual(FMath::Min(1.0f, MotionData.TotalTime / MotionData.Duration), 1.0f))
+	{
+		// The motion ends on this step
+		return false;
+	}
 
-	bMotionDataValid = ClientMoveCustom.SavedMotionData.bHasValidData;
+	// A sweeping motion skips the sweeps only where its path is known to be clear
+	return !MotionData.bSweepDuringMotion || (MotionPathProfile.bValid && !MotionPathProfile.bPawnOnPath && MotionData.TotalTime <= MotionPathProfile.ClearUntilTime);
 }
 
-bool FCharacterNetworkMoveData_Custom::Serialize(UCharacterMovementComponent& CharacterMovement, FArchive& Ar, UPackageMap* PackageMap, ENetworkMoveType MoveType)
+bool UMyCharacterMovementComponent::ClientUpdatePositionAfterServerUpdate()
 {
-	bool bReturn = Super::Serialize(CharacterMovement, Ar, PackageMap, MoveType);
-	if (bReturn)
+	FNetworkPredictionData_Client_Character* ClientData = GetPredictionData_Client_Character();
+	const bool bReplaying = ClientData && ClientData->bUpdatePosition;
+	if (bReplaying && MyCharacterMovementCVars::EnableMotionReplayFastForward != 0)
 	{
-		static FCharacterMotionData EmptyMotionData;
-		UMyCharacterMovementComponent* MyMoveComp = Cast<UMyCharacterMovementComponent>(&CharacterMovement);
-		const bool bIsSaving = Ar.IsSaving();
-	
-		FCharacterMotionData* SerializingMotionData = nullptr;
-		if (bIsSaving)
+		// Flag every motion only move followed by another one, so that a run of them is replayed as a single motion step
+		FSavedMove_Character_Custom* PreviousMotionMove = nullptr;
+		for (const FSavedMovePtr& SavedMove : ClientData->SavedMoves)
 		{
-			SerializingMotionData = bMotionDataValid && !MyMoveComp->GetCurrentMotionData().IsAcked() ? &MyMoveComp->GetCurrentMotionData() : &EmptyMotionData;
+			FSavedMove_Character_Custom* SavedMoveCustom = static_cast<FSavedMove_Character_Custom*>(SavedMove.Get());
+			SavedMoveCustom->bFastForwardMotion = false;
+
+			const bool bMotionOnly = SavedMoveCustom->IsMotionOnlyMove();
+			if (PreviousMotionMove && bMotionOnly)
+			{
+				PreviousMotionMove->bFastForwardMotion = true;
+			}
+			PreviousMotionMove = bMotionOnly ? SavedMoveCustom : nullptr;
 		}
-		else
+	}
+
+	// Each replayed move already defers its updates, this holds them until the whole replay is done so that the mesh, the camera
+	// and the other attached components are moved and overlapped once rather than once per saved move
+	FScopedMovementUpdate ScopedReplayUpdate(bReplaying ? UpdatedComponent : nullptr, bEnableScopedMovementUpdates ? EScopedUpdate::DeferredUpdates : EScopedUpdate::ImmediateUpdates);
+
+	const bool bResult = Super::ClientUpdatePositionAfterServerUpdate();
+	bFastForwardMotionStep = false;
+	bSkippedMotionStep = false;
+	FastForwardStartTime = -1.0f;
+
+	if (bReplaying)
+	{
+		if (MotionData.HasValidData() && !MotionData.IsActive())
 		{
-			SerializingMotionData = &NetMotionData;
+			// No replayed move resumed the motion, the server is already past it
+			MotionQueue.SetFinished(MotionData.Sequence);
+			MotionData.Clear();
 		}
 
-		NetSerializeOptionalValue<FCharacterMotionData>(bIsSaving, Ar, *SerializingMotionData, EmptyMotionData, PackageMap);
-
-		bReturn &= !Ar.IsError();
+		if (!MotionData.HasValidData())
+		{
+			StartNextMotion();
+		}
 	}
-	return bReturn;
+
+	return bResult;
 }
 
-void FCharacterMoveResponseDataContainer_Custom::ServerFillResponseData(const UCharacterMovementComponent& CharacterMovement, const FClientAdjustment& PendingAdjustment)
+void UMyCharacterMovementComponent::ResumeMotion(float CurrentTotalTime)
 {
-	Super::ServerFillResponseData(CharacterMovement, PendingAdjustment);
+	ensure(MotionData.HasValidData());
 
-	const UMyCharacterMovementComponent* MyMoveComp = Cast<const UMyCharacterMovementComponent>(&CharacterMovement);
-	//ServerTotalTime = MyMoveComp->MotionData.TotalTime;
+	StopMovementImmediately();
+	SetMovementMode(EMovementMode::MOVE_Custom, 0);
+
+	MotionData.Resume(CurrentTotalTime);
+	UpdateReplicatedMotion();
 }
 
-bool FCharacterMoveResponseDataContainer_Custom::Serialize(UCharacterMovementComponent& CharacterMovement, FArchive& Ar, UPackageMap* PackageMap)
+void UMyCharacterMovementComponent::SweepMotionPath(float FromTime)
 {
-	bool bReturn = Super::Serialize(CharacterMovement, Ar, PackageMap);
-	if (bReturn && IsCorrection())
+	MotionPathProfile.Reset();
+
+	if (!MotionData.bSweepDuringMotion || MyCharacterMovementCVars::EnableMotionPathSweep == 0 || UpdatedComponent == nullptr)
 	{
-		// Add here custom values to send to the client
-		//Ar << ServerTotalTime;
-		bReturn &= !Ar.IsError();
+		return;
 	}
-	return bReturn;
-}
 
-UMyCharacterMovementComponent::UMyCharacterMovementComponent(const FObjectInitializer& ObjectInitializer)
-	: Super(ObjectInitializer)
-{
-	SetNetworkMoveDataContainer(CustomNetworkMoveDataContainer);
-	SetMoveResponseDataContainer(CustomMoveResponseContainer);
+	const int32 NumSegments = FMath::Max(1, MyCharacterMovementCVars::MotionPathSweepSegments);
+	const FCollisionShape CapsuleShape = GetPawnCapsuleCollisionShape(SHRINK_None);
+	const FQuat CapsuleRotation = UpdatedComponent->GetComponentQuat();
+	const ECollisionChannel CollisionChannel = UpdatedComponent->GetCollisionObjectType();
 
-	const auto CVarNetPackedMovementMaxBits = IConsoleManager::Get().FindConsoleVariable(TEXT("p.NetPackedMovementMaxBits"));
-	CVarNetPackedMovementMaxBits->Set(int32(CVarNetPackedMovementMaxBits->GetInt() + sizeof(FCharacterMotionData) * 8));
-}
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(MotionPathSweep), false, CharacterOwner);
+	FCollisionResponseParams ResponseParams;
+	InitCollisionParams(QueryParams, ResponseParams);
 
-void UMyCharacterMovementComponent::ServerMove_PerformMovement(const FCharacterNetworkMoveData& MoveData)
-{
-	const FCharacterNetworkMoveData_Custom* NetMoveData = static_cast<const FCharacterNetworkMoveData_Custom*>(&MoveData);
-	if (!MotionData.IsActive() && !MotionData.HasValidData() && NetMoveData->NetMotionData.HasValidData())
+	// The path first, its bounds tell which dynamic objects are near it
+	TArray<FVector, TInlineAllocator<16>> SegmentEnds;
+	TArray<float, TInlineAllocator<16>> SegmentEndTimes;
+
+	const FVector PathStart = UpdatedComponent->GetComponentLocation();
+	MotionPathProfile.Bounds = FBox(PathStart, PathStart);
+	for (int32 SegmentIndex = 1; SegmentIndex <= NumSegments; ++SegmentIndex)
 	{
-		// Start Motion on the server the first time we receive a motion data struct.
-		// Client will stop sending the data once acked.
-		StartMotion(NetMoveData->NetMotionData);
+		const float SegmentEndTime = FMath::Lerp(FromTime, (float)MotionData.Duration, (float)SegmentIndex / NumSegments);
+
+		FVector SegmentEnd;
+		FRotator SegmentEndRotation;
+		MotionData.EvaluatePoseAt(SegmentEndTime, SegmentEnd, SegmentEndRotation);
+
+		MotionPathProfile.Bounds += SegmentEnd;
+		SegmentEnds.Add(SegmentEnd);
+		SegmentEndTimes.Add(SegmentEndTime);
 	}
 
-	Super::ServerMove_PerformMovement(MoveData);
-}
+	MotionPathProfile.Bounds = MotionPathProfile.Bounds.ExpandBy(CapsuleShape.GetExtent());
 
-void UMyCharacterMovementComponent::ClientAckGoodMove_Implementation(float TimeStamp)
-{
-	Super::ClientAckGoodMove_Implementation(TimeStamp);
+	// Dynamic objects already on the path are part of the sweeps, only new ones or ones that move on it invalidate them.
+	// Pawns move every frame, they are left out of the sweeps and the steps are swept per tick while one is on the path.
+	MotionPathOverlaps.Reset();
+	GetWorld()->OverlapMultiByObjectType(MotionPathOverlaps, MotionPathProfile.Bounds.GetCenter(), FQuat::Identity, FCollisionObjectQueryParams(FCollisionObjectQueryParams::AllDynamicObjects), FCollisionShape::MakeBox(MotionPathProfile.Bounds.GetExtent()), QueryParams);
+	for (const FOverlapResult& Overlap : MotionPathOverlaps)
+	{
+		const UPrimitiveComponent* Component = Overlap.GetComponent();
+		if (Component == nullptr)
+		{
+			continue;
+		}
 
-	FNetworkPredictionData_Client_Character_Custom* ClientData = static_cast<FNetworkPredictionData_Client_Character_Custom*>(GetPredictionData_Client_Character());
-	check(ClientData);
+		if (const APawn* Pawn = Cast<APawn>(Component->GetOwner()))
+		{
+			QueryParams.AddIgnoredActor(Pawn);
+			MotionPathProfile.bPawnOnPath = true;
+		}
+		else if (!MotionPathProfile.KnownDynamicComponents.ContainsByPredicate([Component](const FMotionPathProfile::FKnownComponent& Known) { return Known.Component == Component; }))
+		{
+			MotionPathProfile.KnownDynamicComponents.Add({ Overlap.Component, Component->Bounds.GetBox() });
+		}
+	}
 
-	const FSavedMove_Character_Custom* LastAckedClientMoveCustom = static_cast<const FSavedMove_Character_Custom*>(ClientData->LastAckedMove.Get());
-	if (LastAckedClientMoveCustom && LastAckedClientMoveCustom->SavedMotionData.bIsActive)
+	FVector SegmentStart = PathStart;
+	float SegmentStartTime = FromTime;
+	MotionPathProfile.ClearUntilTime = MotionData.Duration;
+
+	for (int32 SegmentIndex = 0; SegmentIndex < SegmentEnds.Num(); ++SegmentIndex)
 	{
-		if (MotionData.IsActive() && !MotionData.IsAcked() && MotionData.HasValidData())
+		FHitResult Hit;
+		if (GetWorld()->SweepSingleByChannel(Hit, SegmentStart, SegmentEnds[SegmentIndex], CapsuleRotation, CollisionChannel, CapsuleShape, QueryParams, ResponseParams))
 		{
-			MotionData.Ack();
-			UE_LOG(LogTemp, Log, TEXT("ClientAckGoodMove_Implementation - acking motion data"));
+			// Moves are swept every tick from this segment on
+			MotionPathProfile.ClearUntilTime = SegmentStartTime;
+			break;
 		}
+
+		SegmentStart = SegmentEnds[SegmentIndex];
+		SegmentStartTime = SegmentEndTimes[SegmentIndex];
 	}
+
+	MotionPathProfile.CheckedFrame = GFrameCounter;
+	MotionPathProfile.bValid = true;
 }
 
-void UMyCharacterMovementComponent::OnClientCorrectionReceived(FNetworkPredictionData_Client_Character& ClientData, float TimeStamp, FVector NewLocation, FVector NewVelocity, UPrimitiveComponent* NewBase, FName NewBaseBoneName, bool bHasBase, bool bBaseRelativePosition, uint8 ServerMovementMode)
+bool UMyCharacterMovementComponent::IsMotionPathClear(float FromTime, float ToTime)
 {
-	FCharacterMoveResponseDataContainer_Custom& MoveResponseDataCustom = static_cast<FCharacterMoveResponseDataContainer_Custom&>(GetMoveResponseDataContainer());
-	// Use MoveResponseDataCustom to read data sent from the server
+	if (!MotionPathProfile.bValid || ToTime > MotionPathProfile.ClearUntilTime)
+	{
+		return false;
+	}
 
-	if (MotionData.IsActive() && MotionData.HasValidData())
+	if (MotionPathProfile.CheckedFrame == GFrameCounter)
 	{
-		MotionData.Stop();
+		// Replays and server moves run several steps in the same frame
+		return !MotionPathProfile.bPawnOnPath;
+	}
+	MotionPathProfile.CheckedFrame = GFrameCounter;
 
-		const FSavedMove_Character_Custom* LastAckedClientMoveCustom = static_cast<const FSavedMove_Character_Custom*>(ClientData.LastAckedMove.Get());
-		if (LastAckedClientMoveCustom && LastAckedClientMoveCustom->SavedMotionData.bHasValidData)
+	for (FMotionPathProfile::FKnownComponent& Known : MotionPathProfile.KnownDynamicComponents)
+	{
+		const UPrimitiveComponent* Component = Known.Component.Get();
+		const FBox ComponentBounds = Component ? Component->Bounds.GetBox() : Known.Bounds;
+		if (ComponentBounds.Min.Equals(Known.Bounds.Min, 1.0f) && ComponentBounds.Max.Equals(Known.Bounds.Max, 1.0f))
 		{
-			if (!MotionData.IsAcked())
-			{
-				MotionData.Ack();
-				UE_LOG(LogTemp, Log, TEXT("OnClientCorrectionReceived - acking motion data"));
-			}
+			continue;
+		}
+
+		if (!ComponentBounds.Intersect(MotionPathProfile.Bounds))
+		{
+			// Moved off the path, which can only be clearer for it
+			Known.Bounds = ComponentBounds;
+			continue;
 		}
+
+		// A door or mover moved on the path
+		SweepMotionPath(FromTime);
+		return MotionPathProfile.bValid && ToTime <= MotionPathProfile.ClearUntilTime && !MotionPathProfile.bPawnOnPath;
 	}
 
-	Super::OnClientCorrectionReceived(ClientData, TimeStamp, NewLocation, NewVelocity, NewBase, NewBaseBoneName, bHasBase, bBaseRelativePosition, ServerMovementMode);
-}
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(MotionPathOverlap), false, CharacterOwner);
+	FCollisionResponseParams ResponseParams;
+	InitCollisionParams(QueryParams, ResponseParams);
 
-class FNetworkPredictionData_Client* UMyCharacterMovementComponent::GetPredictionData_Client() const
-{
-	if (ClientPredictionData == nullptr)
+	MotionPathProfile.bPawnOnPath = false;
+	MotionPathOverlaps.Reset();
+	GetWorld()->OverlapMultiByObjectType(MotionPathOverlaps, MotionPathProfile.Bounds.GetCenter(), FQuat::Identity, FCollisionObjectQueryParams(FCollisionObjectQueryParams::AllDynamicObjects), FCollisionShape::MakeBox(MotionPathProfile.Bounds.GetExtent()), QueryParams);
+	for (const FOverlapResult& Overlap : MotionPathOverlaps)
 	{
-		UMyCharacterMovementComponent* MutableThis = const_cast<UMyCharacterMovementComponent*>(this);
-		MutableThis->ClientPredictionData = new FNetworkPredictionData_Client_Character_Custom(*this);
+		const UPrimitiveComponent* Component = Overlap.GetComponent();
+		if (Component && Cast<APawn>(Component->GetOwner()))
+		{
+			// Other characters are swept against per tick, sweeping the whole path again would cost more every time one moves
+			MotionPathProfile.bPawnOnPath = true;
+		}
+		else if (!MotionPathProfile.KnownDynamicComponents.ContainsByPredicate([Component](const FMotionPathProfile::FKnownComponent& Known) { return Known.Component == Component; }))
+		{
+			// Something entered the path since it was swept, sweep what is left of it again
+			SweepMotionPath(FromTime);
+			return MotionPathProfile.bValid && ToTime <= MotionPathProfile.ClearUntilTime && !MotionPathProfile.bPawnOnPath;
+		}
 	}
 
-	return ClientPredictionData;
+	return !MotionPathProfile.bPawnOnPath;
 }
 
-void UMyCharacterMovementComponent::UpdateFromCompressedFlags(uint8 Flags)
+void UMyCharacterMovementComponent::UpdateReplicatedMotion()
 {
-	Super::UpdateFromCompressedFlags(Flags);
+	if (CharacterOwner == nullptr || CharacterOwner->GetLocalRole() != ROLE_Authority || !MyCharacterMovementCVars::ReplicateMotionToSimulatedProxies)
+	{
+		return;
+	}
+
+	if (MotionData.IsActive())
+	{
+		const AGameStateBase* GameState = GetWorld()->GetGameState();
+		const float ServerTime = GameState ? GameState->GetServerWorldTimeSeconds() : GetWorld()->GetTimeSeconds();
+
+		ReplicatedMotion.MotionData = MotionData;
+		ReplicatedMotion.ServerStartTime = ServerTime - MotionData.GetTotalTime();
+		ReplicatedMotion.bActive = true;
+	}
+	else
+	{
+		// The replicated movement takes over again from where the motion left the character
+		ReplicatedMotion.bActive = false;
+	}
 }
 
-void UMyCharacterMovementComponent::PhysCustom(float deltaTime, int32 Iterations)
+void UMyCharacterMovementComponent::OnRep_ReplicatedMotion()
 {
-	if (MotionData.IsActive())
+	if (ReplicatedMotion.bActive)
 	{
-		PhysCustomMotion(deltaTime);
+		MotionData = ReplicatedMotion.MotionData;
+		MotionData.BakeCurves();
+		MotionData.Start();
+		MotionLODToTime = -1.0f;
+	}
+	else
+	{
+		MotionData.Clear();
 	}
 
-	Super::PhysCustom(deltaTime, Iterations);
+	UpdateBatchedMotion(true);
 }
 
-void UMyCharacterMovementComponent::StartMotion(const FCharacterMotionData& NewMotionData)
+void UMyCharacterMovementComponent::UpdateBatchedMotion(bool bMotionChanged)
 {
-	if (MotionData.IsActive() || MotionData.HasValidData())
+	UCharacterMotionSubsystem* MotionSubsystem = GetWorld() ? GetWorld()->GetSubsystem<UCharacterMotionSubsystem>() : nullptr;
+	if (MotionSubsystem == nullptr)
 	{
-		// custom motion already in progress
 		return;
 	}
 
-	MotionData = NewMotionData;
-
-	ResumeMotion(0.0f);
+	const bool bBatched = CharacterOwner && CharacterOwner->GetLocalRole() == ROLE_SimulatedProxy && MotionData.IsActive()
+		&& MotionData.Trajectory == EMotionTrajectory::Linear && MotionLOD == EMotionLOD::Full;
 
-	if (MyCharacterMovementCVars::ShowMotionDebug != 0)
+	if (!bBatched)
 	{
-		DrawDebugCapsule(GetWorld(), MotionData.StartLocation, CharacterOwner->GetSimpleCollisionHalfHeight(), CharacterOwner->GetSimpleCollisionRadius(), FQuat::Identity, FColor::Red, false, 15.0f);
-		DrawDebugCapsule(GetWorld(), MotionData.TargetLocation, CharacterOwner->GetSimpleCollisionHalfHeight(), CharacterOwner->GetSimpleCollisionRadius(), FQuat::Identity, FColor::Red, false, 15.0f);
+		MotionSubsystem->RemoveMotion(this);
+	}
+	else if (bMotionChanged || BatchedMotionSlot == INDEX_NONE)
+	{
+		MotionSubsystem->AddOrUpdateMotion(this);
 	}
 }
 
-void UMyCharacterMovementComponent::PhysCustomMotion(float DeltaTime)
+void UMyCharacterMovementComponent::OnUnregister()
 {
-	MotionData.TotalTime += DeltaTime;
+	if (BatchedMotionSlot != INDEX_NONE)
+	{
+		if (UCharacterMotionSubsystem* MotionSubsystem = GetWorld() ? GetWorld()->GetSubsystem<UCharacterMotionSubsystem>() : nullptr)
+		{
+			MotionSubsystem->RemoveMotion(this);
+		}
+	}
 
-	float MoveValue = FMath::Min(1.0f, MotionData.TotalTime / MotionData.Duration);
-	float LerpValue = MoveValue;
-	bool bEnded = false;
+	Super::OnUnregister();
+}
 
-	if (FMath::IsNearlyEqual(MoveValue, 1.0f))
+void UMyCharacterMovementComponent::SimulateMovement(float DeltaTime)
+{
+	if (CharacterOwner == nullptr || CharacterOwner->GetLocalRole() != ROLE_SimulatedProxy || !MotionData.IsActive())
 	{
-		bEnded = true;
-		LerpValue = 1.0f;
+		Super::SimulateMovement(DeltaTime);
+		return;
 	}
 
-	if (!bEnded && MotionData.MovementSpeedCurve)
+	const AGameStateBase* GameState = GetWorld()->GetGameState();
+	const float ServerTime = GameState ? GameState->GetServerWorldTimeSeconds() : GetWorld()->GetTimeSeconds();
+	const float MotionTime = FMath::Max(0.0f, ServerTime - ReplicatedMotion.ServerStartTime);
+
+	FVector NewLocation;
+	FQuat NewRotation;
+	bool bEnded = false;
+
+	MotionLOD = ComputeMotionLOD();
+	if (MotionLOD == EMotionLOD::Full)
 	{
-		LerpValue = MotionData.MovementSpeedCurve->GetFloatValue(LerpValue);
+		// Batched before actors ticked if the proxy was at full LOD already, at the same server time
+		FRotator NewRotator;
+		const UCharacterMotionSubsystem* MotionSubsystem = GetWorld()->GetSubsystem<UCharacterMotionSubsystem>();
+		if (MotionSubsystem == nullptr || !MotionSubsystem->GetEvaluatedPose(this, MotionTime, NewLocation, NewRotator, bEnded))
+		{
+			bEnded = MotionData.EvaluatePoseAt(MotionTime, NewLocation, NewRotator);
+		}
+		NewRotation = NewRotator.Quaternion();
+		MotionLODToTime = -1.0f;
 	}
+	else
+	{
+		// Evaluate the pose one LOD interval ahead and interpolate to it until then
+		if (MotionTime >= MotionLODToTime)
+		{
+			const float UpdateRate = MotionLOD == EMotionLOD::Medium ? MyCharacterMovementCVars::MotionLODMediumUpdateRate : MyCharacterMovementCVars::MotionLODFarUpdateRate;
+			const float Interval = 1.0f / FMath::Max(UpdateRate, 1.0f);
 
-	FVector_NetQuantize NewLocation = FMath::Lerp(MotionData.StartLocation, MotionData.TargetLocation, LerpValue);
+			if (MotionLODToTime >= 0.0f && MotionTime < MotionLODToTime + Interval)
+			{
+				// Continue from where the previous interval ended, so that the proxy keeps moving through the resample
+				MotionLODFromTime = MotionLODToTime;
+				MotionLODFromLocation = MotionLODToLocation;
+				MotionLODFromRotation = MotionLODToRotation;
+			}
+			else
+			{
+				// First interval, or the proxy fell more than an interval behind
+				FRotator FromRotator;
+				MotionLODFromTime = MotionTime;
+				MotionData.EvaluatePoseAt(MotionTime, MotionLODFromLocation, FromRotator);
+				MotionLODFromRotation = FromRotator.Quaternion();
+			}
 
-	if (!bEnded && MotionData.MovementZMultiplierCurve)
-	{
-		NewLocation.Z += MotionData.MaxZOffset * MotionData.MovementZMultiplierCurve->GetFloatValue(LerpValue);
+			FRotator ToRotator;
+			MotionLODToTime = FMath::Min(MotionLODFromTime + Interval, (float)MotionData.Duration);
+			MotionData.EvaluatePoseAt(MotionLODToTime, MotionLODToLocation, ToRotator);
+			MotionLODToRotation = ToRotator.Quaternion();
+		}
+
+		const float Alpha = MotionLODToTime > MotionLODFromTime ? FMath::Clamp((MotionTime - MotionLODFromTime) / (MotionLODToTime - MotionLODFromTime), 0.0f, 1.0f) : 1.0f;
+		NewLocation = FMath::Lerp(MotionLODFromLocation, MotionLODToLocation, Alpha);
+		NewRotation = FQuat::Slerp(MotionLODFromRotation, MotionLODToRotation, Alpha);
+		bEnded = MotionTime >= (float)MotionData.Duration;
 	}
-	
-	FRotator NewRotation = FMath::Lerp(MotionData.StartRotation, MotionData.TargetRotation, LerpValue);
 
-	FHitResult Hit;
-	SafeMoveUpdatedComponent(NewLocation - GetActorLocation(), NewRotation.Quaternion(), MotionData.bSweepDuringMotion, Hit, ETeleportType::TeleportPhysics);
+	// Animation reads the velocity, it follows the evaluated trajectory
+	Velocity = DeltaTime > 0.0f ? (NewLocation - UpdatedComponent->GetComponentLocation()) / DeltaTime : FVector::ZeroVector;
+	UpdatedComponent->SetWorldLocationAndRotation(NewLocation, NewRotation, false, nullptr, ETeleportType::None);
+
+	RecordMotionSample(MotionTime, MotionData.Sequence, FMotionSample::SimulatedProxy | (bEnded ? FMotionSample::Ended : 0));
 
 	if (bEnded)
 	{
-		SetMovementMode(MotionData.MovementModeOnEnd);
+		Velocity = FVector::ZeroVector;
 		MotionData.Clear();
 	}
 
-	if (MyCharacterMovementCVars::ShowMotionDebug != 0)
+	UpdateBatchedMotion(false);
+
+	LastUpdateLocation = UpdatedComponent->GetComponentLocation();
+	LastUpdateRotation = UpdatedComponent->GetComponentQuat();
+	LastUpdateVelocity = Velocity;
+}
+
+void UMyCharacterMovementComponent::RecordMotionSample(float MotionTime, uint8 Sequence, uint8 Flags, const FVector* Location) const
+{
+	if (!FMotionRecorder::IsEnabled() || CharacterOwner == nullptr)
 	{
-		FColor Color = bEnded ? FColor::Yellow : FColor::Blue;
-		DrawDebugCapsule(GetWorld(), UpdatedComponent->GetComponentLocation(), CharacterOwner->GetSimpleCollisionHalfHeight(), CharacterOwner->GetSimpleCollisionRadius(), FQuat::Identity, Color, false, 5.0f);
+		return;
 	}
+
+	const AGameStateBase* GameState = GetWorld()->GetGameState();
+	const APlayerState* PlayerState = CharacterOwner->GetPlayerState();
+
+	FMotionSample Sample;
+	Sample.WorldTime = GameState ? GameState->GetServerWorldTimeSeconds() : GetWorld()->GetTimeSeconds();
+	Sample.MotionTime = MotionTime;
+	Sample.Location = Location ? *Location : UpdatedComponent->GetComponentLocation();
+	Sample.Rotation = UpdatedComponent->GetComponentRotation();
+	Sample.CharacterId = PlayerState ? (uint32)PlayerState->GetPlayerId() : CharacterOwner->GetUniqueID();
+	Sample.Sequence = Sequence;
+	Sample.Flags = Flags;
+	Sample.Flags |= CharacterOwner->GetLocalRole() == ROLE_Authority ? FMotionSample::Authority : 0;
+	Sample.Flags |= bClientUpdating ? FMotionSample::Replaying : 0;
+
+	FMotionRecorder::Record(Sample);
 }
 
-void UMyCharacterMovementComponent::ResumeMotion(float CurrentTotalTime)
+EMotionLOD UMyCharacterMovementComponent::ComputeMotionLOD() const
 {
-	ensure(MotionData.HasValidData());
+	if (MyCharacterMovementCVars::EnableMotionLOD == 0)
+	{
+		return EMotionLOD::Full;
+	}
 
-	StopMovementImmediately();
-	SetMovementMode(EMovementMode::MOVE_Custom, 0);
+	if (!CharacterOwner->WasRecentlyRendered(0.2f))
+	{
+		return EMotionLOD::Far;
+	}
 
-	MotionData.Resume(CurrentTotalTime);
+	const APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+	if (PlayerController == nullptr || PlayerController->PlayerCameraManager == nullptr)
+	{
+		return EMotionLOD::Full;
+	}
+
+	const float DistanceSquared = FVector::DistSquared(PlayerController->PlayerCameraManager->GetCameraLocation(), UpdatedComponent->GetComponentLocation());
+	if (DistanceSquared >= FMath::Square(MyCharacterMovementCVars::MotionLODFarDistance))
+	{
+		return EMotionLOD::Far;
+	}
+
+	if (DistanceSquared >= FMath::Square(MyCharacterMovementCVars::MotionLODMediumDistance))
+	{
+		return EMotionLOD::Medium;
+	}
+
+	return EMotionLOD::Full;
+}
+
+void UMyCharacterMovementComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME_CONDITION(UMyCharacterMovementComponent, ReplicatedMotion, COND_SimulatedOnly);
 }
 
 void FSavedMove_Character_Custom::Clear()
 {
 	Super::Clear();
+
+	SavedMotionData = FSavedCharacterMotionData();
+	MotionTrigger = EMotionTrigger::None;
+	MotionTriggerSequence = 0;
+	bFastForwardMotion = false;
 }
 
+bool FSavedMove_Character_Custom::IsMotionOnlyMove() const
+{
+	return SavedMotionData.bIsActive && Acceleration.IsZero() && GetCompressedFlags() == 0;
+}
+
+static_assert((uint8)EMotionTrigger::MAX <= (FSavedMove_Character_Custom::MotionTriggerMask >> FSavedMove_Character_Custom::MotionTriggerShift) + 1, "Motion trigger codes do not fit in their compressed flags");
+
 uint8 FSavedMove_Character_Custom::GetCompressedFlags() const
 {
-	return Super::GetCompressedFlags();
+	uint8 Result = Super::GetCompressedFlags();
+	Result |= ((uint8)MotionTrigger << MotionTriggerShift) & MotionTriggerMask;
+	return Result;
 
 	/*
 	 * These are new abilities that we're stuffing into Result. There are 4 pre-defined custom flags:
@@ -283,7 +1842,7 @@ uint8 FSavedMove_Character_Custom::GetCompressedFlags() const
 
 bool FSavedMove_Character_Custom::CanCombineWith(const FSavedMovePtr& NewMove, ACharacter* Character, float MaxDelta) const
 {
-	const FSavedMove_Character_Custom* NewMoveCustom = ((const FSavedMove_Character_Custom*)&NewMove);
+	const FSavedMove_Character_Custom* NewMoveCustom = static_cast<const FSavedMove_Character_Custom*>(NewMove.Get());
 
 	if (SavedMotionData.bIsActive != NewMoveCustom->SavedMotionData.bIsActive ||
 		SavedMotionData.bHasValidData != NewMoveCustom->SavedMotionData.bHasValidData)
@@ -291,9 +1850,44 @@ bool FSavedMove_Character_Custom::CanCombineWith(const FSavedMovePtr& NewMove, A
 		return false;
 	}
 
+	if (SavedMotionData.bIsActive)
+	{
+		if (SavedMotionData.Sequence != NewMoveCustom->SavedMotionData.Sequence)
+		{
+			// A chained motion started
+			return false;
+		}
+
+		// Deterministic motions advance in whole milliseconds, their time can be off the move delta by up to half of one
+		constexpr float MotionTimeContinuityTolerance = 0.001f;
+
+		// A motion step only depends on the motion time, so two steps of the same motion without other input merge into a single longer step.
+		// The new move has to continue the motion exactly where this one left it.
+		if (!IsMotionOnlyMove() || !NewMoveCustom->IsMotionOnlyMove()
+			|| !FMath::IsNearlyEqual(SavedMotionData.TotalTime + DeltaTime, NewMoveCustom->SavedMotionData.TotalTime, MotionTimeContinuityTolerance))
+		{
+			return false;
+		}
+	}
+
 	return Super::CanCombineWith(NewMove, Character, MaxDelta);
 }
 
+void FSavedMove_Character_Custom::CombineWith(const FSavedMove_Character* OldMove, ACharacter* InCharacter, APlayerController* PC, const FVector& OldStartLocation)
+{
+	Super::CombineWith(OldMove, InCharacter, PC, OldStartLocation);
+
+	const FSavedMove_Character_Custom* OldMoveCustom = static_cast<const FSavedMove_Character_Custom*>(OldMove);
+	if (SavedMotionData.bIsActive && OldMoveCustom->SavedMotionData.bIsActive)
+	{
+		// The combined move starts where the old one did, so rewind the motion clock along with the character
+		SavedMotionData.TotalTime = OldMoveCustom->SavedMotionData.TotalTime;
+
+		UMyCharacterMovementComponent* MyCharMoveComp = CastChecked<UMyCharacterMovementComponent>(InCharacter->GetCharacterMovement());
+		MyCharMoveComp->ResumeMotion(SavedMotionData.TotalTime);
+	}
+}
+
 void FSavedMove_Character_Custom::SetMoveFor(ACharacter* Character, float InDeltaTime, FVector const& NewAccel, class FNetworkPredictionData_Client_Character& ClientData)
 {
 	Super::SetMoveFor(Character, InDeltaTime, NewAccel, ClientData);
@@ -305,11 +1899,36 @@ void FSavedMove_Character_Custom::SetMoveFor(ACharacter* Character, float InDelt
 	SavedMotionData.TotalTime = MyCharMoveComp->GetCurrentMotionData().GetTotalTime();
 	SavedMotionData.bIsActive = MyCharMoveComp->GetCurrentMotionData().IsActive();
 	SavedMotionData.bHasValidData = MyCharMoveComp->GetCurrentMotionData().HasValidData();
+	SavedMotionData.Sequence = MyCharMoveComp->GetCurrentMotionData().Sequence;
+	SavedMotionData.LatestSequence = MyCharMoveComp->NextMotionSequence;
+
+	// The trigger is consumed by the move performed right after this
+	MotionTrigger = MyCharMoveComp->PendingMotionTrigger;
 }
 
 void FSavedMove_Character_Custom::PostUpdate(ACharacter* Character, EPostUpdateMode PostUpdateMode)
 {
 	Super::PostUpdate(Character, PostUpdateMode);
+
+	UMyCharacterMovementComponent* MyCharMoveComp = CastChecked<UMyCharacterMovementComponent>(Character->GetCharacterMovement());
+	if (PostUpdateMode == PostUpdate_Record && MotionTrigger != EMotionTrigger::None)
+	{
+		// The trigger is only sent if it started a motion on the client, with the sequence it got
+		MotionTrigger = MyCharMoveComp->bMotionTriggerRefused ? EMotionTrigger::None : MotionTrigger;
+		MotionTriggerSequence = MyCharMoveComp->MotionTriggerSequence;
+		MyCharMoveComp->bMotionTriggerRefused = false;
+	}
+
+	if (PostUpdateMode == PostUpdate_Replay && MyCharMoveComp->bSkippedMotionStep)
+	{
+		// The character only moves with the last move of a fast-forwarded run, this one ends where the motion is at its end time.
+		// The run is known to be clear, so it is where the character would have been. Resent moves send it as their client location.
+		FVector MotionLocation;
+		FRotator MotionRotation;
+		MyCharMoveComp->GetCurrentMotionData().EvaluatePoseAt(MyCharMoveComp->GetCurrentMotionData().GetTotalTime(), MotionLocation, MotionRotation);
+		SavedLocation = MotionLocation;
+		SavedRotation = MotionRotation;
+	}
 }
 
 void FSavedMove_Character_Custom::PrepMoveFor(class ACharacter* Character)
@@ -319,17 +1938,74 @@ void FSavedMove_Character_Custom::PrepMoveFor(class ACharacter* Character)
 	/* Saved Move ---> Character Movement Data */
 
 	UMyCharacterMovementComponent* MyCharMoveComp = CastChecked<UMyCharacterMovementComponent>(Character->GetCharacterMovement());
-	if (MyCharMoveComp->GetCurrentMotionData().HasValidData() && !MyCharMoveComp->GetCurrentMotionData().IsActive() && SavedMotionData.bIsActive)
+	MyCharMoveComp->bFastForwardMotionStep = bFastForwardMotion;
+	MyCharMoveComp->bSkippedMotionStep = false;
+
+	const FCharacterMotionData& CurrentMotionData = MyCharMoveComp->GetCurrentMotionData();
+	const bool bRunningSavedMotion = CurrentMotionData.IsActive() && CurrentMotionData.HasValidData() && CurrentMotionData.Sequence == SavedMotionData.Sequence;
+
+	if (SavedMotionData.bIsActive && !bRunningSavedMotion && MyCharMoveComp->RestoreMotion(SavedMotionData.Sequence))
 	{
 		// When a correction is received from the server, the client state is rollbacked to what the server said (including movement mode), and the all the saved moves are replayed.
-		// This move is the first one containing motion data after a correction, so resume motion from its accumulated total time.
+		// This move is the first one containing this motion after a correction, so resume motion from its accumulated total time.
+		// It can be a motion that already ended before the correction, the ones chained after it wait for it to end again.
 		MyCharMoveComp->ResumeMotion(SavedMotionData.TotalTime);
 
-		UE_LOG(LogTemp, Log, TEXT("--------- PrepMoveFor - move Timestamp %f - motion total time - : %f"), TimeStamp, SavedMotionData.TotalTime);
+		MOTION_STAT(OnMotionResumed());
 	}
 }
 
 FSavedMovePtr FNetworkPredictionData_Client_Character_Custom::AllocateNewMove()
 {
-	return FSavedMovePtr(new FSavedMove_Character_Custom());
-}
\ No newline at end of file
+	// Only called when FreeMoves is empty, more moves are in use than it was filled with
+	MOTION_STAT(OnSavedMoveAllocated());
+	++NumAllocatedMoves;
+	bAllocatedMove = true;
+	return MakeShared<FSavedMove_Character_Custom>();
+}
+
+FSavedMovePtr FNetworkPredictionData_Client_Character_Custom::CreateSavedMove()
+{
+	if (!bFilledFreeMoves)
+	{
+		// Only the client controlling the character saves moves, simulated proxies create this data for smoothing and never get here.
+		// Allocated all at once, so that neither the next moves nor the bursts around corrections allocate.
+		SavedMoves.Reserve(MaxSavedMoveCount);
+		FreeMoves.Reserve(MaxFreeMoveCount);
+		while (FreeMoves.Num() < MaxFreeMoveCount)
+		{
+			FreeMoves.Push(MakeShared<FSavedMove_Character_Custom>());
+			++NumAllocatedMoves;
+		}
+		bFilledFreeMoves = true;
+	}
+
+	// The base class can free every saved move into FreeMoves before taking one, only AllocateNewMove tells that none was reused
+	bAllocatedMove = false;
+
+	FSavedMovePtr NewMove = Super::CreateSavedMove();
+	if (NewMove.IsValid())
+	{
+		if (!bAllocatedMove)
+		{
+			MOTION_STAT(OnSavedMoveReused());
+		}
+
+		SavedMoveHighWaterMark = FMath::Max(SavedMoveHighWaterMark, NumAllocatedMoves - FreeMoves.Num());
+		MOTION_STAT(OnSavedMovePoolUsage(FreeMoves.Num(), SavedMoveHighWaterMark));
+	}
+
+	return NewMove;
+}
+
+void FNetworkPredictionData_Client_Character_Custom::FreeMove(const FSavedMovePtr& Move)
+{
+	if (Move.IsValid() && FreeMoves.Num() >= MaxFreeMoveCount)
+	{
+		// Only happens after AllocateNewMove added moves, the base class lets this one go
+		--NumAllocatedMoves;
+		MOTION_STAT(OnSavedMoveDropped());
+	}
+
+	Super::FreeMove(Move);
+}
\ No newline at end of file
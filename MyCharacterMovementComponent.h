@@ -4,15 +4,33 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/CharacterMovementComponent.h"
+#include "WorldCollision.h"
+#include "MotionStats.h"
+#include "MotionTrajectory.h"
 #include "MyCharacterMovementComponent.generated.h"
 
+/* Motions the client starts with a code in the custom compressed flags of a move, the server builds them from its own move state */
+UENUM()
+enum class EMotionTrigger : uint8
+{
+	None,
+	// AMyProjectCharacter::MakePredictiveMotion
+	Dash,
+	MAX UMETA(Hidden)
+};
+
 USTRUCT()
 struct MYPROJECT_API FCharacterMotionData
 {
 	friend class UMyCharacterMovementComponent;
+	friend class FCharacterMotionQueue;
+	friend class UCharacterMotionSubsystem;
 
 	GENERATED_BODY()
 
+	static constexpr uint8 NoPreset = MAX_uint8;
+	static constexpr int32 MaxControlPoints = FMotionArcLengthTable::MaxSplinePoints - 2;
+
 	UPROPERTY()
 	FVector_NetQuantize StartLocation;
 
@@ -25,11 +43,12 @@ struct MYPROJECT_API FCharacterMotionData
 	UPROPERTY()
 	FRotator TargetRotation;
 
+	// Sent as their index in the UCharacterMotionPresetRegistry curve manifest, which keeps them loaded
 	UPROPERTY()
-	UCurveFloat* MovementSpeedCurve = nullptr;
+	TSoftObjectPtr<UCurveFloat> MovementSpeedCurve;
 
 	UPROPERTY()
-	UCurveFloat* MovementZMultiplierCurve = nullptr;
+	TSoftObjectPtr<UCurveFloat> MovementZMultiplierCurve;
 
 	UPROPERTY()
 	uint8 MaxZOffset = 0;
@@ -43,12 +62,50 @@ struct MYPROJECT_API FCharacterMotionData
 	UPROPERTY()
 	TEnumAsByte<EMovementMode> MovementModeOnEnd = EMovementMode::MOVE_Walking;
 
+	// Index of the UCharacterMotionPresetRegistry preset providing the settings above, only start and target are sent when set
+	UPROPERTY()
+	uint8 PresetIndex = NoPreset;
+
+	// Assigned by the client when the motion is started, orders queued motions and their acks. Wraps around.
+	UPROPERTY()
+	uint8 Sequence = 0;
+
+	// Evaluated from quantized inputs over whole millisecond steps, so that the client and the server compute the same poses
+	UPROPERTY()
+	bool bDeterministic = false;
+
+	// Spline trajectories go through the control points in order between the start and the target
+	UPROPERTY()
+	EMotionTrajectory Trajectory = EMotionTrajectory::Linear;
+
+	UPROPERTY()
+	FVector_NetQuantize ControlPoints[MaxControlPoints];
+
+	UPROPERTY()
+	uint8 NumControlPoints = 0;
+
 private:
 
 	float TotalTime = 0.0f;
+	int32 TotalTimeMs = 0;
 	bool bActive = false;
 	bool bAcked = false;
 
+	// Handles of the baked curves in FMotionCurveCache, resolved when the motion starts
+	int32 SpeedCurveHandle = INDEX_NONE;
+	int32 ZMultiplierCurveHandle = INDEX_NONE;
+
+	// Built with the curves when the motion starts, spline trajectories only
+	TSharedPtr<const FMotionArcLengthTable> ArcLengthTable;
+
+	// Client timestamp of the move whose compressed flags triggered the motion, negative for motions sent in full
+	float TriggerTimeStamp = -1.0f;
+
+#if MOTION_STATS
+	// When the client started the motion, for the ack latency histogram
+	double RequestTime = 0.0;
+#endif
+
 public:
 
 	FCharacterMotionData() = default;
@@ -67,9 +124,23 @@ public:
 	void Resume(float CurrentTotalTime)
 	{
 		TotalTime = CurrentTotalTime;
+		TotalTimeMs = FMath::RoundToInt(CurrentTotalTime * 1000.0f);
 		bActive = true;
 	}
 
+	void AdvanceTime(float DeltaTime)
+	{
+		if (bDeterministic)
+		{
+			TotalTimeMs += FMath::RoundToInt(DeltaTime * 1000.0f);
+			TotalTime = TotalTimeMs / 1000.0f;
+		}
+		else
+		{
+			TotalTime += DeltaTime;
+		}
+	}
+
 	void Ack()
 	{
 		bAcked = true;
@@ -82,15 +153,53 @@ public:
 		MaxZOffset = 0;
 		Duration = 0;
 		bSweepDuringMotion = false;
+		Sequence = 0;
+		bDeterministic = false;
+		Trajectory = EMotionTrajectory::Linear;
+		NumControlPoints = 0;
 
 		TotalTime = 0.0f;
+		TotalTimeMs = 0;
 		bActive = false;
 		bAcked = false;
+
+		SpeedCurveHandle = INDEX_NONE;
+		ZMultiplierCurveHandle = INDEX_NONE;
+		ArcLengthTable.Reset();
+		TriggerTimeStamp = -1.0f;
 	}
 
+	/* Copies the curves, Z offset, duration, sweep flag and end mode of a registered preset. Returns false if there is no such preset. */
+	bool ApplyPreset(int32 InPresetIndex);
+
+	/* Adds a point the motion goes through before its target, making it a spline. Returns false if it already has MaxControlPoints. */
+	bool AddControlPoint(const FVector& Location);
+
+	/**
+	 * Bakes the motion curves, or finds them already baked, so they can be evaluated without going through the UCurveFloat. Builds the arc length table of splines.
+	 * Never loads a curve, one that is not loaded yet is left out and warned about once.
+	 */
+	void BakeCurves();
+
+	/* Computes the pose of the motion at the given time. Returns true if the motion reached its end at that time. */
+	bool EvaluatePoseAt(float Time, FVector& OutLocation, FRotator& OutRotation) const;
+
+	/* Computes the pose of the motion at its current total time */
+	bool EvaluatePose(FVector& OutLocation, FRotator& OutRotation) const
+	{
+		return EvaluatePoseAtClock(GetClockTime(), OutLocation, OutRotation);
+	}
+
+	/* Time, duration and steps in the units the motion is evaluated in: whole milliseconds for deterministic motions, seconds otherwise */
+	float GetClockTime() const { return bDeterministic ? (float)TotalTimeMs : TotalTime; }
+	float GetClockDuration() const { return bDeterministic ? (float)(Duration * 1000) : (float)Duration; }
+	float ToClockStep(float DeltaTime) const { return bDeterministic ? (float)FMath::RoundToInt(DeltaTime * 1000.0f) : DeltaTime; }
+
 	bool HasValidData() const { return Duration > 0; }
+	bool HasPreset() const { return PresetIndex != NoPreset; }
 	bool IsActive() const { return bActive;	}
 	bool IsAcked() const { return bAcked; }
+	bool IsTriggered() const { return TriggerTimeStamp >= 0.0f; }
 	float GetTotalTime() const { return TotalTime; }
 
 	bool operator==(const FCharacterMotionData& Other) const
@@ -100,77 +209,190 @@ public:
 
 	bool operator!=(const FCharacterMotionData& Other) const
 	{
-		return StartLocation != Other.StartLocation || TargetLocation != Other.TargetLocation || StartRotation != Other.StartRotation || TargetRotation != Other.TargetRotation
-			|| Duration != Duration;
+		if (StartLocation != Other.StartLocation || TargetLocation != Other.TargetLocation || StartRotation != Other.StartRotation || TargetRotation != Other.TargetRotation
+			|| Duration != Other.Duration || Trajectory != Other.Trajectory || NumControlPoints != Other.NumControlPoints)
+		{
+			return true;
+		}
+
+		for (int32 Index = 0; Index < NumControlPoints; ++Index)
+		{
+			if (ControlPoints[Index] != Other.ControlPoints[Index])
+			{
+				return true;
+			}
+		}
+
+		return false;
 	}
 
-	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess)
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+
+private:
+
+	bool EvaluatePoseAtClock(float ClockTime, FVector& OutLocation, FRotator& OutRotation) const;
+
+	/* Compiled with MOTION_FP_CONTRACT_OFF like the trajectory and curve evaluation it calls, all of them through MotionDeterminism rather than FMath,
+	 * so that deterministic motions evaluate to the same pose on any client and server build */
+	template<EMotionTrajectory Kind>
+	bool EvaluatePoseAtClockImpl(float ClockTime, FVector& OutLocation, FRotator& OutRotation) const;
+};
+
+template<>
+struct TStructOpsTypeTraits<FCharacterMotionData> : public TStructOpsTypeTraitsBase2<FCharacterMotionData>
+{
+	enum
 	{
-		bool bLocalSuccess = true;
+		WithNetSerializer = true,
+	};
+};
 
-		StartLocation.NetSerialize(Ar, Map, bLocalSuccess);
-		TargetLocation.NetSerialize(Ar, Map, bLocalSuccess);
+// Motion the server replicates once to simulated proxies, which evaluate it locally instead of receiving the movement of every frame
+USTRUCT()
+struct MYPROJECT_API FReplicatedCharacterMotion
+{
+	GENERATED_BODY()
 
-		uint32 YawPitchINT = 0;
-		uint8 RollBYTE = 0;
+	UPROPERTY()
+	FCharacterMotionData MotionData;
 
-		if (Ar.IsSaving())
-		{
-			// Compress rotation down to 5 bytes
-			// StartRotation
-			YawPitchINT = UCharacterMovementComponent::PackYawAndPitchTo32(StartRotation.Yaw, StartRotation.Pitch);
-			RollBYTE = FRotator::CompressAxisToByte(StartRotation.Roll);
+	// Server world time the motion started at, proxies evaluate it at the server time they are at
+	UPROPERTY()
+	float ServerStartTime = 0.0f;
 
-			Ar << YawPitchINT;
-			Ar << RollBYTE;
+	UPROPERTY()
+	bool bActive = false;
+};
 
-			// TargetRotation
-			YawPitchINT = UCharacterMovementComponent::PackYawAndPitchTo32(TargetRotation.Yaw, TargetRotation.Pitch);
-			RollBYTE = FRotator::CompressAxisToByte(TargetRotation.Roll);
+// Fidelity a simulated proxy evaluates a replicated motion at, from how much it matters to the local view
+enum class EMotionLOD : uint8
+{
+	// Evaluated every frame
+	Full,
+	// Evaluated at p.MotionLOD.MediumUpdateRate, the transform is interpolated in between
+	Medium,
+	// Evaluated at p.MotionLOD.FarUpdateRate, for far or off-screen characters
+	Far
+};
 
-			Ar << YawPitchINT;
-			Ar << RollBYTE;
-		}
-		else
-		{
-			Ar << YawPitchINT;
-			Ar << RollBYTE;
-			uint16 Pitch = (YawPitchINT & 65535);
-			uint16 Yaw = (YawPitchINT >> 16);
-
-			StartRotation.Pitch = FRotator::DecompressAxisFromShort(Pitch);
-			StartRotation.Yaw = FRotator::DecompressAxisFromShort(Yaw);
-			StartRotation.Roll = FRotator::DecompressAxisFromByte(RollBYTE);
-
-			Ar << YawPitchINT;
-			Ar << RollBYTE;
-			Pitch = (YawPitchINT & 65535);
-			Yaw = (YawPitchINT >> 16);
-
-			TargetRotation.Pitch = FRotator::DecompressAxisFromShort(Pitch);
-			TargetRotation.Yaw = FRotator::DecompressAxisFromShort(Yaw);
-			TargetRotation.Roll = FRotator::DecompressAxisFromByte(RollBYTE);
-		}
+// Result of sweeping the whole path of a motion along its sampled trajectory
+struct FMotionPathProfile
+{
+	// Motion time up to which the path was swept clear
+	float ClearUntilTime = 0.0f;
+
+	// Bounds of the swept path, capsule included
+	FBox Bounds = FBox(ForceInit);
+
+	// Dynamic components other than pawns that were already inside the bounds when the path was swept, with their last known bounds
+	struct FKnownComponent
+	{
+		TWeakObjectPtr<UPrimitiveComponent> Component;
+		FBox Bounds;
+	};
+	TArray<FKnownComponent, TInlineAllocator<4>> KnownDynamicComponents;
+
+	// Frame the dynamic objects were last checked on, the world does not change in between, however many steps run
+	uint64 CheckedFrame = 0;
 
-		Ar << MovementSpeedCurve;
-		Ar << MovementZMultiplierCurve;
-		Ar << MaxZOffset;
-		Ar << Duration;
-		Ar << bSweepDuringMotion;
-		Ar << MovementModeOnEnd;
-		
-		bOutSuccess = bLocalSuccess;
-		return !Ar.IsError();
+	// Pawns are left out of the path sweeps, steps are swept per tick while one is inside the bounds
+	bool bPawnOnPath = false;
+
+	bool bValid = false;
+
+	void Reset()
+	{
+		ClearUntilTime = 0.0f;
+		Bounds = FBox(ForceInit);
+		KnownDynamicComponents.Reset();
+		CheckedFrame = 0;
+		bPawnOnPath = false;
+		bValid = false;
 	}
 };
 
-template<>
-struct TStructOpsTypeTraits<FCharacterMotionData> : public TStructOpsTypeTraitsBase2<FCharacterMotionData>
+/**
+ * Motions of a component in sequence order: the ones waiting for the active motion to end, the active one, and the last
+ * finished ones, kept so that a replay going back to an earlier motion can restore it.
+ */
+class FCharacterMotionQueue
 {
-	enum
+public:
+
+	static constexpr int32 Capacity = 8;
+	static constexpr int32 MaxPendingMotions = 3;
+
+	/* Whether sequence A was assigned after sequence B */
+	static bool IsNewerSequence(uint8 A, uint8 B) { return (int8)(A - B) > 0; }
+
+	/* Adds a motion that starts when the ones before it have ended. Fails if MaxPendingMotions are already waiting. */
+	bool Enqueue(const FCharacterMotionData& Motion);
+
+	/* Makes the oldest pending motion the active one */
+	bool PopPending(FCharacterMotionData& OutMotion);
+
+	/* Makes a motion the active one again, the ones after it go back to waiting. Returns null if it is not in the queue anymore. */
+	const FCharacterMotionData* Activate(uint8 Sequence);
+
+	void SetFinished(uint8 Sequence);
+	void Remove(uint8 Sequence);
+
+	/* Acks every motion up to and including the given sequence */
+	void AckUpTo(uint8 Sequence);
+
+	/* Pending motions not acked yet, oldest first */
+	void GetUnackedPending(TArray<FCharacterMotionData*, TInlineAllocator<MaxPendingMotions>>& OutMotions);
+
+	int32 GetNumPending() const;
+
+private:
+
+	enum class EEntryState : uint8
 	{
-		WithNetSerializer = true,
+		Free,
+		Pending,
+		Active,
+		Finished
 	};
+
+	struct FEntry
+	{
+		FCharacterMotionData Motion;
+		EEntryState State = EEntryState::Free;
+	};
+
+	FEntry* Find(uint8 Sequence);
+
+	FEntry Entries[Capacity];
+};
+
+// Token bucket of the motions a client can start on the server, refilled in server time
+struct FMotionStartBudget
+{
+	// Negative until the first start, the bucket starts full
+	float Tokens = -1.0f;
+	float LastRefillTime = 0.0f;
+
+	/* Refills Rate tokens per second up to Burst, then takes one if there is one */
+	bool TryConsume(float Time, float Rate, float Burst);
+};
+
+// Totals of what the client sent and received about its motions, read by the soak test
+struct FMotionNetStats
+{
+	int32 MotionsStarted = 0;
+	// Payloads and trigger codes sent, every send after the first of a motion is a resend
+	int32 MotionsSent = 0;
+	// The part of the resends carried by old moves, sent again because they were important and not acked
+	int32 MotionsResentAsImportant = 0;
+	int32 Corrections = 0;
+	int32 CorrectionsDuringMotion = 0;
+	double TotalCorrectionError = 0.0;
+	float MaxCorrectionError = 0.0f;
+	// Server side, distance between the client and the server at the end of the move that ended each motion of the client
+	int32 MotionEnds = 0;
+	double TotalMotionEndError = 0.0;
+	float MaxMotionEndError = 0.0f;
 };
 
 // Data used by the saved move structure to save data about the current character motion
@@ -179,6 +401,10 @@ struct FSavedCharacterMotionData
 	float TotalTime = 0.0;
 	bool bHasValidData = false;
 	bool bIsActive = false;
+
+	// Sequence of the current motion, and the last sequence the client had assigned when the move was made
+	uint8 Sequence = 0;
+	uint8 LatestSequence = 0;
 };
 
 struct FCharacterNetworkMoveData_Custom : public FCharacterNetworkMoveData
@@ -202,8 +428,20 @@ struct FCharacterNetworkMoveData_Custom : public FCharacterNetworkMoveData
 	// Used to determine whether of not serialize motion data
 	bool bMotionDataValid = false;
 
-	// Data de-serialized on the server
-	FCharacterMotionData NetMotionData;
+	// Last motion sequence assigned when the move was made, motions started after it go with later moves
+	uint8 LatestMotionSequence = 0;
+
+	// Sequence the client gave the motion of the trigger in the compressed flags, only sent along with one
+	uint8 MotionTriggerSequence = 0;
+
+	// Data de-serialized on the server: the motion the client is running and the ones it queued after it, oldest first
+	TArray<FCharacterMotionData, TInlineAllocator<FCharacterMotionQueue::MaxPendingMotions + 1>> NetMotions;
+
+	// Bit per entry of NetMotions whose payload was skipped because it was over the motion start budget
+	uint8 ThrottledMotionMask = 0;
+
+	// Number of bits the motion payload used the last time this move was serialized
+	uint32 MotionBits = 0;
 };
 
 
@@ -238,8 +476,20 @@ struct FCharacterMoveResponseDataContainer_Custom : public FCharacterMoveRespons
 	 */
 	virtual bool Serialize(UCharacterMovementComponent& CharacterMovement, FArchive& Ar, UPackageMap* PackageMap);
 
-	// Add data to be sent from the server
-	//float ServerTotalTime = 0.0f;
+	// Motion state of the server after the corrected move, the client resumes its replay from it
+	bool bServerMotionActive = false;
+	uint8 ServerMotionSequence = 0;
+	uint32 ServerMotionTimeMs = 0;
+
+	// Last motion sequence the server received, every motion up to it is acked. Always sent with corrections, with good moves when bMotionAck is set.
+	uint8 ServerLastReceivedMotionSequence = 0;
+
+	// Whether the client sent motions since the last response, so that it stops sending them as soon as it can
+	bool bMotionAck = false;
+
+	// Whether the server refused a motion the client sent, and which one
+	bool bMotionRejected = false;
+	uint8 RejectedMotionSequence = 0;
 };
 
 /**
@@ -250,19 +500,46 @@ class MYPROJECT_API UMyCharacterMovementComponent : public UCharacterMovementCom
 {
 	GENERATED_BODY()
 
+	friend struct FCharacterNetworkMoveData_Custom;
+	friend struct FCharacterMoveResponseDataContainer_Custom;
+	friend class FSavedMove_Character_Custom;
+	friend class UMotionBenchmarkCommandlet;
+	friend class UCharacterMotionSubsystem;
+
 public:
 
 	UMyCharacterMovementComponent(const FObjectInitializer& ObjectInitializer = FObjectInitializer::Get());
 
 	virtual void ServerMove_PerformMovement(const FCharacterNetworkMoveData& MoveData) override;
+	virtual bool ServerCheckClientError(float ClientTimeStamp, float DeltaTime, const FVector& Accel, const FVector& ClientLoc, const FVector& RelativeClientLoc, UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode) override;
 	virtual void ClientAckGoodMove_Implementation(float TimeStamp) override;
+	virtual void ServerSendMoveResponse(const FClientAdjustment& PendingAdjustment) override;
+	virtual void ClientHandleMoveResponse(const FCharacterMoveResponseDataContainer& MoveResponse) override;
+	virtual bool ClientUpdatePositionAfterServerUpdate() override;
 
+	/* Starts the motion, or queues it to start when the current one and the ones already queued have ended */
 	virtual void StartMotion(const FCharacterMotionData& NewMotionData);
 	virtual void ResumeMotion(float CurrentTotalTime);
 
+	/* Starts the motion of a trigger with the next move. Only the trigger code is sent, the server builds the same motion at the start of the move. */
+	void TriggerMotion(EMotionTrigger Trigger);
+
+	/* Makes the motion with the given sequence the current one again, when a replay goes back to it */
+	bool RestoreMotion(uint8 Sequence);
+
 	const FCharacterMotionData& GetCurrentMotionData() const { return MotionData; }
 	FCharacterMotionData& GetCurrentMotionData() { return MotionData; }
 
+	/* Number of bits used by the motion payload of the last move sent or received */
+	uint32 GetLastMoveMotionBits() const { return LastMoveMotionBits; }
+
+	const FMotionNetStats& GetMotionNetStats() const { return MotionNetStats; }
+
+	/* Whether simulated proxies are evaluating the current motion themselves, the replicated movement is not needed while they are */
+	bool IsReplicatingMotion() const { return ReplicatedMotion.bActive; }
+
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
 protected:
 
 	virtual void OnClientCorrectionReceived(FNetworkPredictionData_Client_Character& ClientData, float TimeStamp, FVector NewLocation, FVector NewVelocity, UPrimitiveComponent* NewBase, FName NewBaseBoneName, bool bHasBase, bool bBaseRelativePosition, uint8 ServerMovementMode) override;
@@ -270,7 +547,143 @@ protected:
 
 	virtual void PhysCustomMotion(float DeltaTime);
 
+	/* Starts the motion of the pending trigger from the state of the character at the start of the move */
+	virtual void UpdateCharacterStateBeforeMovement(float DeltaSeconds) override;
+
+	/* Builds the motion of a trigger from the state of the character, the same way on the client and the server. Returns false if there is none. */
+	virtual bool BuildTriggeredMotion(EMotionTrigger Trigger, FCharacterMotionData& OutMotion) const;
+
+	/* Simulated proxies evaluate the replicated motion at the current server time, and simulate the usual way otherwise */
+	virtual void SimulateMovement(float DeltaTime) override;
+
+	/* Starts the motion right away if none is running, queues it otherwise. Returns false if the queue is full. */
+	bool QueueMotion(const FCharacterMotionData& NewMotionData);
+
+	/* Starts the oldest queued motion */
+	bool StartNextMotion();
+
+	/* Drops the motion with the given sequence, running or queued */
+	void DropMotion(uint8 Sequence);
+
+	/* Acks the current and queued motions up to the given sequence, so the client stops sending them */
+	void AckMotionsUpTo(uint8 Sequence);
+
+	/* Whether the current motion step of a replay can only advance the motion time, leaving the move to a later step */
+	bool CanFastForwardMotionStep() const;
+
+	/**
+	 * Server side, while a move is read: whether the payload of a motion should be read. Resent motions the server already
+	 * has are skipped, new ones are charged to the motion start budget once and skipped with bOutThrottled set if it is empty.
+	 */
+	bool ServerShouldReadMotion(uint8 Sequence, bool& bOutThrottled);
+
+	/* Takes a motion start from the budget of the client. Returns false if it started too many already. */
+	bool ServerConsumeMotionStart();
+
+	/* Number of sweeps a motion step moving by Delta is split in, so that none of them moves further than the capsule radius */
+	int32 GetMotionSweepSubsteps(const FVector& Delta) const;
+
+	/* Sweeps the path of the motion from FromTime to its end in a few segments and caches up to when it is clear */
+	void SweepMotionPath(float FromTime);
+
+	/* Whether the step of the motion between the given times can move without sweeping. Sweeps the path again only when a dynamic object moves on it, never while a pawn is on it. */
+	bool IsMotionPathClear(float FromTime, float ToTime);
+
+	/* Cheap checks of a motion received from the client: walking or falling at its end, duration in range, start close to the server location and target in range */
+	bool ServerValidateMotion(const FCharacterMotionData& NewMotionData) const;
+
+	/* Queues async traces along the path of the motion that just started, it is rejected when they land if the path goes through the world */
+	void ServerValidateMotionPath();
+	void OnMotionValidationTraceDone(const FTraceHandle& TraceHandle, FTraceDatum& TraceDatum);
+
+	/* Drops the motion and corrects the client so that it drops it too */
+	void ServerRejectMotion(const FCharacterMotionData& RejectedMotion);
+
+	/* Replicates the motion that started on the server to simulated proxies, or that none is running anymore */
+	void UpdateReplicatedMotion();
+
+	/* Records the pose of the character at a step of a motion with the FMotionRecorder, at the given location rather than the current one if set */
+	void RecordMotionSample(float MotionTime, uint8 Sequence, uint8 Flags, const FVector* Location = nullptr) const;
+
+	/* LOD of the replicated motion of a simulated proxy, from its distance to the local camera and whether it was rendered */
+	EMotionLOD ComputeMotionLOD() const;
+
+	UFUNCTION()
+	void OnRep_ReplicatedMotion();
+
+	/* Keeps the replicated motion in the UCharacterMotionSubsystem batch while the proxy evaluates it at full LOD, refreshing it if it changed */
+	void UpdateBatchedMotion(bool bMotionChanged);
+
+	virtual void OnUnregister() override;
+
 	FCharacterMotionData MotionData;
+	FCharacterMotionQueue MotionQueue;
+
+	// Last sequence the client assigned to a motion, and the last one the server received
+	uint8 NextMotionSequence = 0;
+	uint8 LastReceivedMotionSequence = 0;
+
+	// Set when a move carried motions, the next response acks them
+	bool bMotionAckPending = false;
+
+	// Server side budget of the motions the client starts, the last sequence charged to it and which of the 32 up to it were throttled
+	FMotionStartBudget MotionStartBudget;
+	uint8 LastBudgetedMotionSequence = 0;
+	uint32 ThrottledMotionSequences = 0;
+
+	// Motion payloads are written aside to prefix them with their size
+	FBitWriter MotionPayloadWriter;
+
+	uint32 LastMoveMotionBits = 0;
+	FMotionNetStats MotionNetStats;
+
+	// Trigger of the move being made, set by TriggerMotion on the client and from the compressed flags on the server
+	EMotionTrigger PendingMotionTrigger = EMotionTrigger::None;
+
+	// Set on the client when the trigger of the move being made did not start a motion, so that the saved move does not send it
+	bool bMotionTriggerRefused = false;
+
+	// Sequence of the motion started by the trigger of the move being made, the client sends it and the server gives it to the motion
+	uint8 MotionTriggerSequence = 0;
+
+	FMotionPathProfile MotionPathProfile;
+	TArray<FOverlapResult> MotionPathOverlaps;
+
+	UPROPERTY(ReplicatedUsing = OnRep_ReplicatedMotion)
+	FReplicatedCharacterMotion ReplicatedMotion;
+
+	// Simulated proxies below full LOD evaluate the pose at MotionLODToTime and interpolate to it from the end of the previous interval
+	EMotionLOD MotionLOD = EMotionLOD::Full;
+	float MotionLODFromTime = 0.0f;
+	float MotionLODToTime = -1.0f;
+	FVector MotionLODFromLocation = FVector::ZeroVector;
+	FVector MotionLODToLocation = FVector::ZeroVector;
+	FQuat MotionLODFromRotation = FQuat::Identity;
+	FQuat MotionLODToRotation = FQuat::Identity;
+
+	// Slot of the replicated motion in the UCharacterMotionSubsystem batch
+	int32 BatchedMotionSlot = INDEX_NONE;
+
+	// Set by the saved move being replayed when the next one is a motion only move too
+	bool bFastForwardMotionStep = false;
+
+	// Whether the last motion step only advanced the motion time, and the motion time the run of such steps started at, negative outside of one
+	bool bSkippedMotionStep = false;
+	float FastForwardStartTime = -1.0f;
+
+	// Server side validation of client motions
+	FTraceDelegate MotionValidationTraceDelegate;
+	FCharacterMotionData ValidatingMotionData;
+	uint8 RejectedMotionSequence = 0;
+	FVector MotionValidationRestoreLocation = FVector::ZeroVector;
+	uint32 MotionValidationId = 0;
+	int32 PendingMotionValidationTraces = 0;
+	bool bMotionValidationBlocked = false;
+	bool bMotionRejected = false;
+	bool bForceMotionCorrection = false;
+
+	// Set on the server when a motion of the client ended during the move being checked
+	bool bMotionEndedThisMove = false;
 
 	FCharacterNetworkMoveDataContainer_Custom CustomNetworkMoveDataContainer;
 	FCharacterMoveResponseDataContainer_Custom CustomMoveResponseContainer;
@@ -292,6 +705,10 @@ class FSavedMove_Character_Custom : public FSavedMove_Character
 public:
 	typedef FSavedMove_Character Super;
 
+	// The motion trigger code takes FLAG_Custom_0 and FLAG_Custom_1
+	static constexpr uint8 MotionTriggerShift = 4;
+	static constexpr uint8 MotionTriggerMask = FLAG_Custom_0 | FLAG_Custom_1;
+
 	/* Sets the default values for the saved move */
 	virtual void Clear() override;
 
@@ -301,6 +718,9 @@ public:
 	/* Checks if an old move can be combined with a new move for replication purposes (are they different or the same) */
 	virtual bool CanCombineWith(const FSavedMovePtr& NewMove, ACharacter* Character, float MaxDelta) const override;
 
+	/* Combines this move with the old move it replaces, rewinding the motion to the time the old move started at */
+	virtual void CombineWith(const FSavedMove_Character* OldMove, ACharacter* InCharacter, APlayerController* PC, const FVector& OldStartLocation) override;
+
 	/* Populates the FSavedMove fields from the corresponding character movement controller variables. This is used when
 	 * making a new SavedMove and the data will be used when playing back saved moves in the event that a correction needs to happen.*/
 	virtual void SetMoveFor(ACharacter* Character, float InDeltaTime, FVector const& NewAccel, class FNetworkPredictionData_Client_Character& ClientData) override;
@@ -312,12 +732,23 @@ public:
 	/** Set the properties describing the final position, etc. of the moved pawn. */
 	virtual void PostUpdate(ACharacter* Character, EPostUpdateMode PostUpdateMode) override;
 
+	/* Whether this move only advances an active motion, without input or flags */
+	bool IsMotionOnlyMove() const;
+
 	FSavedCharacterMotionData SavedMotionData;
+
+	// Motion started by the compressed flags of this move, and the sequence the client gave it
+	EMotionTrigger MotionTrigger = EMotionTrigger::None;
+	uint8 MotionTriggerSequence = 0;
+
+	// Set before a replay when the next saved move is a motion only move too
+	bool bFastForwardMotion = false;
 };
 
 /*
  * This subclass of FNetworkPredictionData_Client_Character is used to create new copies of
  * our custom FSavedMove_Character class defined above.
+ * FreeMoves is filled up to MaxFreeMoveCount the first time a move is saved, so that saved moves are recycled from it rather than allocated.
  */
 class FNetworkPredictionData_Client_Character_Custom : public FNetworkPredictionData_Client_Character
 {
@@ -326,6 +757,25 @@ public:
 
 	FNetworkPredictionData_Client_Character_Custom(const UCharacterMovementComponent& ClientMovement) : Super(ClientMovement) {}
 
-	/* Allocates a new copy of our custom saved move */
+	/* Allocates a new copy of our custom saved move, only when FreeMoves ran out */
 	virtual FSavedMovePtr AllocateNewMove() override;
+
+	/* Takes a move from FreeMoves, filled the first time, and tracks how many are in use */
+	virtual FSavedMovePtr CreateSavedMove() override;
+
+	/* Returns a move to FreeMoves, it is deleted if FreeMoves is full */
+	virtual void FreeMove(const FSavedMovePtr& Move) override;
+
+	/* Largest number of saved moves that were out of FreeMoves at once */
+	int32 GetSavedMoveHighWaterMark() const { return SavedMoveHighWaterMark; }
+
+private:
+
+	// Moves owned by this prediction data, in FreeMoves or in use
+	int32 NumAllocatedMoves = 0;
+	int32 SavedMoveHighWaterMark = 0;
+
+	// Whether FreeMoves was filled yet, and whether the move being created was allocated rather than reused
+	bool bFilledFreeMoves = false;
+	bool bAllocatedMove = false;
 };
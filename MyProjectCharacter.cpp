@@ -6,9 +6,11 @@
 #include "Components/CapsuleComponent.h"
 #include "Components/InputComponent.h"
 #include "MyCharacterMovementComponent.h"
+#include "CharacterMotionPresets.h"
 #include "GameFramework/Controller.h"
 #include "GameFramework/SpringArmComponent.h"
 #include "MyActorComponent.h"
+#include "Net/UnrealNetwork.h"
 
 //////////////////////////////////////////////////////////////////////////
 // AMyProjectCharacter
@@ -53,6 +55,29 @@ AMyProjectCharacter::AMyProjectCharacter(const FObjectInitializer& ObjectInitial
 	ActorComp = Cast<UMyActorComponent>(CreateDefaultSubobject(TEXT("ActorComp"), FinalCompClass, FinalCompClass, true, false));*/
 }
 
+void AMyProjectCharacter::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// Already loaded when they are in the curve manifest, the dash must not wait on them the first time it is used
+	if (UCharacterMotionPresetRegistry* PresetRegistry = UCharacterMotionPresetRegistry::Get())
+	{
+		PresetRegistry->PreloadCurves({ MovementCurve.ToSoftObjectPath(), MovementZOffsetCurve.ToSoftObjectPath() });
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Replication
+
+void AMyProjectCharacter::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+	Super::PreReplication(ChangedPropertyTracker);
+
+	// Simulated proxies evaluate a replicated motion themselves, the movement is only replicated again once it has ended
+	const UMyCharacterMovementComponent* MoveComp = Cast<UMyCharacterMovementComponent>(GetCharacterMovement());
+	DOREPLIFETIME_ACTIVE_OVERRIDE_PRIVATE_PROPERTY(AActor, ReplicatedMovement, IsReplicatingMovement() && !(MoveComp && MoveComp->IsReplicatingMotion()));
+}
+
 //////////////////////////////////////////////////////////////////////////
 // Input
 
@@ -158,11 +183,23 @@ void AMyProjectCharacter::MoveRight(float Value)
 }
 
 void AMyProjectCharacter::StartPredictiveMotion()
+{
+	Cast<UMyCharacterMovementComponent>(GetCharacterMovement())->TriggerMotion(EMotionTrigger::Dash);
+}
+
+FCharacterMotionData AMyProjectCharacter::MakePredictiveMotion() const
 {
 	FCharacterMotionData MotionData(GetActorLocation(), GetActorLocation() + (GetActorForwardVector() * 350.0f), GetActorRotation(), GetActorRotation() + FRotator(0.0f, 90.0f, 0.0f), 4);
-	MotionData.MovementSpeedCurve = MovementCurve;
-	MotionData.MovementZMultiplierCurve = MovementZOffsetCurve;
-	MotionData.MaxZOffset = 120.0f;
 
-	Cast<UMyCharacterMovementComponent>(GetCharacterMovement())->StartMotion(MotionData);
+	const UCharacterMotionPresetRegistry* PresetRegistry = UCharacterMotionPresetRegistry::Get();
+	const int32 PresetIndex = PresetRegistry && !MotionPreset.IsNone() ? PresetRegistry->FindPresetIndex(MotionPreset) : INDEX_NONE;
+	if (PresetIndex == INDEX_NONE || !MotionData.ApplyPreset(PresetIndex))
+	{
+		MotionData.MovementSpeedCurve = MovementCurve;
+		MotionData.MovementZMultiplierCurve = MovementZOffsetCurve;
+		MotionData.MaxZOffset = 120.0f;
+		MotionData.Duration = 4;
+	}
+
+	return MotionData;
 }
@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Character.h"
+#include "MyCharacterMovementComponent.h"
 #include "MyProjectCharacter.generated.h"
 
 UCLASS(config=Game)
@@ -63,18 +64,32 @@ protected:
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
 	// End of APawn interface
 
+	// AActor interface
+	virtual void BeginPlay() override;
+	virtual void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
+	// End of AActor interface
+
 public:
 	/** Returns CameraBoom subobject **/
 	FORCEINLINE class USpringArmComponent* GetCameraBoom() const { return CameraBoom; }
 	/** Returns FollowCamera subobject **/
 	FORCEINLINE class UCameraComponent* GetFollowCamera() const { return FollowCamera; }
 
+	/** Curves of the dash when MotionPreset is not set. List them in the preset registry AdditionalCurves to have them preloaded and sent. */
+	UPROPERTY(EditDefaultsOnly)
+	TSoftObjectPtr<UCurveFloat> MovementCurve;
+
 	UPROPERTY(EditDefaultsOnly)
-	UCurveFloat* MovementCurve;
+	TSoftObjectPtr<UCurveFloat> MovementZOffsetCurve;
 
+	/** Row of the motion preset table used by StartPredictiveMotion, the curves above are used when it is not set */
 	UPROPERTY(EditDefaultsOnly)
-	UCurveFloat* MovementZOffsetCurve;
+	FName MotionPreset;
 
+	/* Dash forward with a quarter turn, triggered with the next move so that only its trigger code is sent to the server */
 	void StartPredictiveMotion();
+
+	/* Builds the dash from the current location and rotation, the server builds the same one from its own state */
+	FCharacterMotionData MakePredictiveMotion() const;
 };
 